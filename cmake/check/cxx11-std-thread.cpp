@@ -0,0 +1,9 @@
+#include <thread>
+
+static void noop() { }
+
+int main() {
+	std::thread thread(noop);
+	thread.join();
+	return 0;
+}
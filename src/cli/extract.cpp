@@ -22,18 +22,31 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <set>
 #include <sstream>
 #include <vector>
 #include <limits>
 
+#include "configure.hpp"
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
+
 #include <boost/foreach.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
@@ -47,31 +60,46 @@
 #include "cli/debug.hpp"
 #include "cli/gog.hpp"
 #include "cli/goggalaxy.hpp"
+#include "cli/journal.hpp"
+#include "cli/manifest.hpp"
+#include "cli/sink.hpp"
+#include "cli/store.hpp"
 
 #include "crypto/checksum.hpp"
 #include "crypto/hasher.hpp"
 
 #include "loader/offsets.hpp"
 
+#include "setup/cache.hpp"
+#include "setup/component.hpp"
 #include "setup/data.hpp"
 #include "setup/directory.hpp"
 #include "setup/expression.hpp"
 #include "setup/file.hpp"
 #include "setup/info.hpp"
+#include "setup/item.hpp"
 #include "setup/language.hpp"
+#include "setup/task.hpp"
+#include "setup/type.hpp"
 
 #include "stream/chunk.hpp"
 #include "stream/file.hpp"
+#include "stream/seekindex.hpp"
 #include "stream/slice.hpp"
 
 #include "util/boostfs_compat.hpp"
+#include "util/cache.hpp"
 #include "util/console.hpp"
+#include "util/copy.hpp"
 #include "util/encoding.hpp"
 #include "util/fstream.hpp"
 #include "util/load.hpp"
 #include "util/log.hpp"
 #include "util/output.hpp"
+#include "util/storage.hpp"
+#include "util/thread.hpp"
 #include "util/time.hpp"
+#include "util/unique_ptr.hpp"
 
 namespace fs = boost::filesystem;
 
@@ -127,7 +155,9 @@ class file_output : private boost::noncopyable {
 	
 	fs::path path_;
 	const processed_file * file_;
+	util::write_cache_limiter cache_; // Must be closed after the stream
 	util::fstream stream_;
+	output_sink * sink_;
 	
 	crypto::hasher checksum_;
 	boost::uint64_t checksum_position_;
@@ -139,9 +169,18 @@ class file_output : private boost::noncopyable {
 	
 public:
 	
-	explicit file_output(const fs::path & dir, const processed_file * f, bool write)
+	/*!
+	 * Create an output file on disk.
+	 *
+	 * \param dir   The output directory.
+	 * \param f     The file to write.
+	 * \param write Whether to actually create the file.
+	 * \param size  The expected final size of the file, used to preallocate disk space.
+	 */
+	file_output(const fs::path & dir, const processed_file * f, bool write, boost::uint64_t size)
 		: path_(dir / f->path())
 		, file_(f)
+		, sink_(NULL)
 		, checksum_(f->entry().checksum.type)
 		, checksum_position_(f->entry().checksum.type == crypto::None ? boost::uint64_t(-1) : 0)
 		, position_(0)
@@ -149,6 +188,10 @@ public:
 		, write_(write)
 	{
 		if(write_) {
+			// Replace existing files instead of truncating them: they may be links to
+			// contents shared with other files, such as in a content store
+			boost::system::error_code ec;
+			fs::remove(path_, ec);
 			try {
 				std::ios_base::openmode flags = std::ios_base::out | std::ios_base::binary | std::ios_base::trunc;
 				if(file_->is_multipart()) {
@@ -161,12 +204,39 @@ public:
 			} catch(...) {
 				throw std::runtime_error("Could not open output file \"" + path_.string() + '"');
 			}
+			if(!util::preallocate(path_, size)) {
+				throw std::runtime_error("Not enough space to write \"" + path_.string() + '"');
+			}
 		}
 	}
 	
+	/*!
+	 * Stream the file to a sink instead of writing it to disk.
+	 *
+	 * Data must be written sequentially, and \ref close() must be called once the file
+	 * is complete.
+	 */
+	file_output(const processed_file * f, output_sink & sink, boost::uint64_t size,
+	            util::time mtime, boost::uint32_t nsec)
+		: path_(f->path())
+		, file_(f)
+		, sink_(&sink)
+		, checksum_(f->entry().checksum.type)
+		, checksum_position_(f->entry().checksum.type == crypto::None ? boost::uint64_t(-1) : 0)
+		, position_(0)
+		, total_written_(0)
+		, write_(true)
+	{
+		sink_->begin_file(f->path(), size, mtime, nsec);
+	}
+	
 	bool write(const char * data, size_t n) {
 		
-		if(write_) {
+		if(sink_) {
+			if(!sink_->write(data, n)) {
+				return false;
+			}
+		} else if(write_) {
 			stream_.write(data, std::streamsize(n));
 		}
 		
@@ -178,9 +248,55 @@ public:
 		position_ += n;
 		total_written_ += n;
 		
+		if(cache_.is_due(position_) && !stream_.flush().fail()) {
+			cache_.written(position_);
+		}
+		
 		return !write_ || !stream_.fail();
 	}
 	
+	//! Keep the data written to the output file from accumulating in the page cache.
+	void limit_cache() {
+		if(write_ && !sink_) {
+			cache_.open(path_);
+		}
+	}
+	
+	/*!
+	 * Prepare the output file for being written to directly.
+	 *
+	 * \return the path of the output file, or \c NULL if the output is not a file on disk.
+	 */
+	const fs::path * direct_path() {
+		
+		if(sink_ || !write_ || stream_.flush().fail()) {
+			return NULL;
+		}
+		
+		return &path_;
+	}
+	
+	/*!
+	 * Account for data that has been written to the output file directly.
+	 *
+	 * Use \ref seek() to move the stream position past the data once done.
+	 *
+	 * \param position The position in the file where the data was written.
+	 */
+	void written(boost::uint64_t position, const char * data, size_t n) {
+		
+		if(checksum_position_ == position) {
+			checksum_.update(data, n);
+			checksum_position_ += n;
+		}
+		
+		total_written_ += n;
+		
+		if(cache_.is_due(position + n)) {
+			cache_.written(position + n);
+		}
+	}
+	
 	void seek(boost::uint64_t new_position) {
 		
 		if(new_position == position_) {
@@ -189,6 +305,10 @@ public:
 		
 		debug("seeking output from " << print_hex(position_) << " to " << print_hex(new_position));
 		
+		if(sink_) {
+			throw std::runtime_error("Cannot seek in output stream for \"" + path_.string() + '"');
+		}
+		
 		if(!write_) {
 			position_ = new_position;
 			return;
@@ -213,7 +333,9 @@ public:
 	
 	void close() {
 		
-		if(write_) {
+		if(sink_) {
+			sink_->end_file();
+		} else if(write_) {
 			stream_.close();
 		}
 		
@@ -236,7 +358,7 @@ public:
 			return true;
 		}
 		
-		if(!write_) {
+		if(!write_ || sink_) {
 			return false;
 		}
 		
@@ -271,6 +393,40 @@ public:
 		return checksum_.finalize();
 	}
 	
+	/*!
+	 * Calculate a checksum of another type by reading back the complete output file.
+	 *
+	 * \return \c false if the output is not a file on disk or could not be read.
+	 */
+	bool calculate_checksum(crypto::checksum_type type, crypto::checksum & result) {
+		
+		if(!write_ || sink_ || stream_.flush().fail()) {
+			return false;
+		}
+		
+		debug("calculating " << type << " checksum for " << path_);
+		
+		util::ifstream ifs(path_, std::ios_base::in | std::ios_base::binary);
+		if(!ifs.is_open()) {
+			return false;
+		}
+		
+		crypto::hasher hasher(type);
+		while(!ifs.eof()) {
+			char buffer[8192];
+			std::streamsize n = ifs.read(buffer, sizeof(buffer)).gcount();
+			hasher.update(buffer, size_t(n));
+		}
+		
+		if(ifs.bad()) {
+			return false;
+		}
+		
+		result = hasher.finalize();
+		
+		return true;
+	}
+	
 };
 
 class path_filter {
@@ -729,6 +885,161 @@ bool print_file_info(const extract_options & o, const setup::info & info) {
 	return multiple_sections;
 }
 
+//! Fixed components can not be deselected.
+bool is_fixed(const setup::component_entry & entry) {
+	return !!(entry.options & setup::component_entry::Fixed);
+}
+
+bool is_fixed(const setup::task_entry & /* entry */) {
+	return false;
+}
+
+/*!
+ * Resolve a selection of component or task names.
+ *
+ * \param entries   The components or tasks defined by the installer.
+ * \param selected  Which entries are selected by default - updated with the new selection.
+ * \param selection Names to select. Names prefixed with \c * also select all children,
+ *                  names prefixed with \c ! deselect the entry and all children.
+ *                  Child names start with the parent name followed by a backslash.
+ *                  Fixed components are always selected.
+ * \param what      Type of the entries for error messages.
+ *
+ * \return the names of all selected entries, including parents of selected entries.
+ */
+template <class Entry>
+std::vector<std::string> select_entries(const std::vector<Entry> & entries, std::vector<bool> & selected,
+                                        const std::vector<std::string> & selection, const char * what) {
+	
+	std::vector<std::string> names;
+	BOOST_FOREACH(const Entry & entry, entries) {
+		names.push_back(boost::algorithm::to_lower_copy(entry.name));
+	}
+	
+	BOOST_FOREACH(const std::string & item, selection) {
+		
+		bool deselect = (!item.empty() && item[0] == '!');
+		bool children = deselect || (!item.empty() && item[0] == '*');
+		std::string name = boost::algorithm::to_lower_copy(item.substr(deselect || children ? 1 : 0));
+		
+		std::vector<std::string>::const_iterator it = std::find(names.begin(), names.end(), name);
+		if(it == names.end()) {
+			throw std::runtime_error(std::string("Unknown ") + what + ": " + item);
+		}
+		
+		selected[size_t(it - names.begin())] = !deselect;
+		if(children) {
+			for(size_t i = 0; i < names.size(); i++) {
+				if(boost::starts_with(names[i], name + '\\')) {
+					selected[i] = !deselect;
+				}
+			}
+		}
+		
+	}
+	
+	for(size_t i = 0; i < entries.size(); i++) {
+		if(is_fixed(entries[i])) {
+			selected[i] = true;
+		}
+	}
+	
+	// Parents of selected entries are at least partially selected
+	std::vector<std::string> result;
+	for(size_t i = 0; i < names.size(); i++) {
+		bool used = selected[i];
+		for(size_t j = 0; !used && j < names.size(); j++) {
+			used = selected[j] && boost::starts_with(names[j], names[i] + '\\');
+		}
+		if(used) {
+			result.push_back(entries[i].name);
+		}
+	}
+	
+	return result;
+}
+
+/*!
+ * Components and tasks selected using the \c --type, \c --components and \c --tasks options.
+ *
+ * Names are matched case-insensitively, like Inno Setup does on the command line.
+ */
+class install_profile {
+	
+	bool filter_components;
+	bool filter_tasks;
+	std::vector<std::string> components;
+	std::vector<std::string> tasks;
+	
+public:
+	
+	install_profile(const extract_options & o, const setup::info & info);
+	
+	//! \return true if the entry is installed for the selected components and tasks.
+	bool match(const setup::item & item) const {
+		if(filter_components && !item.components.empty()
+		   && !setup::expression_match(components, item.components)) {
+			return false;
+		}
+		if(filter_tasks && !item.tasks.empty() && !setup::expression_match(tasks, item.tasks)) {
+			return false;
+		}
+		return true;
+	}
+	
+};
+
+install_profile::install_profile(const extract_options & o, const setup::info & info)
+	: filter_components(o.select_components), filter_tasks(o.select_tasks) {
+	
+	if(filter_components) {
+		
+		std::vector<bool> selected(info.components.size(), false);
+		
+		if(!o.setup_type.empty()) {
+			const setup::type_entry * type = NULL;
+			BOOST_FOREACH(const setup::type_entry & entry, info.types) {
+				if(boost::algorithm::iequals(entry.name, o.setup_type)) {
+					type = &entry;
+				}
+			}
+			if(!type) {
+				throw std::runtime_error("Unknown setup type: " + o.setup_type);
+			}
+			for(size_t i = 0; i < info.components.size(); i++) {
+				const std::string & types = info.components[i].types;
+				selected[i] = !types.empty() && setup::expression_match(type->name, types);
+			}
+		}
+		
+		components = select_entries(info.components, selected, o.components, "component");
+		
+	}
+	
+	if(filter_tasks) {
+		
+		std::vector<bool> selected(info.tasks.size(), false);
+		tasks = select_entries(info.tasks, selected, o.tasks, "task");
+		
+		// Tasks are only available if their components are selected
+		if(filter_components) {
+			std::vector<std::string>::iterator end = tasks.begin();
+			BOOST_FOREACH(const std::string & name, tasks) {
+				BOOST_FOREACH(const setup::task_entry & task, info.tasks) {
+					if(task.name == name && (task.components.empty()
+					                         || setup::expression_match(components, task.components))) {
+						*end++ = name;
+						break;
+					}
+				}
+			}
+			tasks.erase(end, tasks.end());
+		}
+		
+	}
+	
+}
+
 struct processed_entries {
 	
 	FilesMap files;
@@ -754,6 +1065,8 @@ processed_entries filter_entries(const extract_options & o, const setup::info &
 	
 	path_filter includes(o);
 	
+	install_profile profile(o, info);
+	
 	// Filter the directories to be created
 	BOOST_FOREACH(const setup::directory_entry & directory, info.directories) {
 		
@@ -769,6 +1082,10 @@ processed_entries filter_entries(const extract_options & o, const setup::info &
 			continue; // Ignore language-agnostic dirs
 		}
 		
+		if(!profile.match(directory)) {
+			continue; // Ignore dirs for unselected components or tasks
+		}
+		
 		std::string path = o.filenames.convert(directory.name);
 		if(path.empty()) {
 			continue; // Don't know what to do with this
@@ -814,6 +1131,19 @@ processed_entries filter_entries(const extract_options & o, const setup::info &
 			continue; // Ignore language-agnostic files
 		}
 		
+		if(!profile.match(file)) {
+			continue; // Ignore files for unselected components or tasks
+		}
+		
+		if(o.bits != 0) {
+			const setup::file_entry::flags arch_flags = setup::file_entry::Bits32 | setup::file_entry::Bits64;
+			setup::file_entry::flags other = (o.bits == 64) ? setup::file_entry::Bits32
+			                                                : setup::file_entry::Bits64;
+			if((file.options & arch_flags) == other) {
+				continue; // Ignore files for other architectures
+			}
+		}
+		
 		std::string path = o.filenames.convert(file.destination);
 		if(path.empty()) {
 			continue; // Internal file, not extracted
@@ -897,105 +1227,2463 @@ processed_entries filter_entries(const extract_options & o, const setup::info &
 	return processed;
 }
 
-void create_output_directory(const extract_options & o) {
+/*!
+ * Filter the entries for each variant selected using \c o.variants.
+ *
+ * Each variant is filtered separately, including collision handling, and placed in its
+ * own subdirectory. Files from all variants that use the same data share a data entry
+ * and are extracted together.
+ */
+processed_entries filter_variants(const extract_options & o, const setup::info & info) {
 	
-	try {
-		if(!o.output_dir.empty() && !fs::exists(o.output_dir)) {
-			fs::create_directory(o.output_dir);
+	if(o.variants == NoVariants) {
+		return filter_entries(o, info);
+	}
+	
+	std::vector<std::string> names;
+	std::vector<extract_options> variants;
+	if(o.variants == LanguageVariants) {
+		BOOST_FOREACH(const setup::language_entry & language, info.languages) {
+			names.push_back(language.name);
+			variants.push_back(o);
+			variants.back().language = language.name;
 		}
-	} catch(...) {
-		throw std::runtime_error("Could not create output directory \"" + o.output_dir.string() + '"');
+		if(variants.empty()) {
+			throw std::runtime_error("Installer does not define any languages");
+		}
+	} else {
+		const size_t bits[] = { 32, 64 };
+		BOOST_FOREACH(size_t b, bits) {
+			std::ostringstream oss;
+			oss << b << "bit";
+			names.push_back(oss.str());
+			variants.push_back(o);
+			variants.back().bits = b;
+		}
+	}
+	
+	processed_entries processed;
+	
+	for(size_t i = 0; i < variants.size(); i++) {
+		
+		std::string name = names[i];
+		std::replace(name.begin(), name.end(), '/', '_');
+		std::replace(name.begin(), name.end(), '\\', '_');
+		if(name.empty() || name == "." || name == "..") {
+			std::ostringstream oss;
+			oss << "variant" << i;
+			name = oss.str();
+		}
+		std::string internal_name = boost::algorithm::to_lower_copy(name);
+		
+		processed_directory root(name);
+		root.set_implied(true);
+		processed.directories.insert(std::make_pair(internal_name, root));
+		
+		processed_entries variant = filter_entries(variants[i], info);
+		
+		BOOST_FOREACH(DirectoriesMap::value_type & directory, variant.directories) {
+			directory.second.set_path(name + setup::path_sep + directory.second.path());
+			processed.directories.insert(std::make_pair(internal_name + setup::path_sep + directory.first,
+			                                            directory.second));
+		}
+		
+		BOOST_FOREACH(FilesMap::value_type & file, variant.files) {
+			file.second.set_path(name + setup::path_sep + file.second.path());
+			processed.files.insert(std::make_pair(internal_name + setup::path_sep + file.first, file.second));
+		}
+		
 	}
 	
+	return processed;
 }
 
-} // anonymous namespace
+//! \return the total size of all parts of a file.
+boost::uint64_t output_size(const setup::info & info, const processed_file & file) {
+	
+	boost::uint64_t size = info.data_entries[file.entry().location].uncompressed_size;
+	BOOST_FOREACH(boost::uint32_t location, file.entry().additional_locations) {
+		size += info.data_entries[location].uncompressed_size;
+	}
+	
+	return size;
+}
 
-void process_file(const fs::path & installer, const extract_options & o) {
+//! \return the timestamp to use for files extracted from the given data entry.
+util::time file_time(const extract_options & o, const setup::data_entry & data) {
 	
-	bool is_directory;
-	try {
-		is_directory = fs::is_directory(installer);
-	} catch(...) {
-		throw std::runtime_error("Could not open file \"" + installer.string()
-		                         + "\": access denied");
+	if(!o.preserve_file_times) {
+		return util::time(std::time(NULL));
 	}
-	if(is_directory) {
-		throw std::runtime_error("Input file \"" + installer.string() + "\" is a directory!");
+	
+	util::time filetime = data.timestamp;
+	if(o.local_timestamps && !(data.options & data.TimeStampInUTC)) {
+		filetime = util::to_local_time(filetime);
 	}
 	
-	util::ifstream ifs;
-	try {
-		ifs.open(installer, std::ios_base::in | std::ios_base::binary);
-		if(!ifs.is_open()) {
-			throw std::exception();
+	return filetime;
+}
+
+//! \return all data entries of a file in order.
+std::vector<boost::uint32_t> file_locations(const processed_file & file) {
+	
+	std::vector<boost::uint32_t> locations(1, file.entry().location);
+	locations.insert(locations.end(), file.entry().additional_locations.begin(),
+	                 file.entry().additional_locations.end());
+	
+	return locations;
+}
+
+//! \return true if the data read from a stream matches a checksum.
+bool check_data(std::istream & is, boost::uint64_t size, const crypto::checksum & expected) {
+	
+	crypto::hasher hasher(expected.type);
+	char buffer[8192 * 10];
+	while(size != 0) {
+		std::streamsize n = std::streamsize(std::min(boost::uint64_t(sizeof(buffer)), size));
+		if(is.read(buffer, n).fail()) {
+			return false;
 		}
-	} catch(...) {
-		throw std::runtime_error("Could not open file \"" + installer.string() + '"');
+		hasher.update(buffer, size_t(n));
+		size -= boost::uint64_t(n);
 	}
 	
-	loader::offsets offsets;
-	offsets.load(ifs);
+	return hasher.finalize() == expected;
+}
+
+//! Result of comparing an existing file with the contents stored in the installer.
+enum file_state {
+	FileMatches,
+	FileModified,
+	FileMissing,
+	FileUnknown //!< There is no usable checksum to compare the file with
+};
+
+//! Compare the contents of a stream with the checksums stored in the installer.
+file_state check_contents(std::istream & is, const setup::info & info, const processed_file & file) {
 	
-	#ifdef DEBUG
-	if(logger::debug) {
-		print_offsets(offsets);
-		std::cout << '\n';
+	if(file.entry().checksum.type != crypto::None) {
+		return check_data(is, output_size(info, file), file.entry().checksum) ? FileMatches : FileModified;
 	}
-	#endif
 	
-	if(o.data_version)  {
-		setup::version version;
-		ifs.seekg(offsets.header_offset);
-		version.load(ifs);
-		if(o.silent) {
-			std::cout << version << '\n';
-		} else {
-			std::cout << color::white << version << color::reset << '\n';
+	std::vector<boost::uint32_t> locations = file_locations(file);
+	
+	BOOST_FOREACH(boost::uint32_t location, locations) {
+		const setup::data_entry & data = info.data_entries[location];
+		if(data.file.checksum.type == crypto::None || data.file.filter == stream::ZlibFilter) {
+			return FileUnknown; // Checksum is missing or for the compressed data
 		}
-		return;
 	}
 	
-	#ifdef DEBUG
-	if(o.dump_headers)  {
-		create_output_directory(o);
-		dump_headers(ifs, offsets, o);
-		return;
+	BOOST_FOREACH(boost::uint32_t location, locations) {
+		const setup::data_entry & data = info.data_entries[location];
+		if(!check_data(is, data.uncompressed_size, data.file.checksum)) {
+			return FileModified;
+		}
 	}
-	#endif
 	
-	setup::info::entry_types entries = 0;
-	if(o.list || o.test || o.extract || (o.gog_galaxy && o.list_languages)) {
-		entries |= setup::info::Files;
-		entries |= setup::info::Directories;
-		entries |= setup::info::DataEntries;
-	}
-	if(o.list_languages) {
-		entries |= setup::info::Languages;
+	return FileMatches;
+}
+
+//! Compare an existing output file with the checksums stored in the installer.
+file_state check_file(const extract_options & o, const setup::info & info, const processed_file & file) {
+	
+	fs::path path = o.output_dir / file.path();
+	boost::system::error_code ec;
+	if(!fs::is_regular_file(path, ec) || ec) {
+		return FileMissing;
 	}
-	if(o.gog_game_id || o.gog) {
-		entries |= setup::info::RegistryEntries;
+	if(fs::file_size(path, ec) != output_size(info, file) || ec) {
+		return FileModified;
 	}
-	if(!o.extract_unknown) {
-		entries |= setup::info::NoUnknownVersion;
+	
+	util::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+	if(!ifs.is_open()) {
+		return FileModified;
 	}
-#ifdef DEBUG
-	if(logger::debug) {
-		entries = setup::info::entry_types::all();
+	
+	return check_contents(ifs, info, file);
+}
+
+/*!
+ * Check if an existing output file already has the expected contents according to
+ * \c o.existing.
+ */
+bool is_up_to_date(const extract_options & o, const setup::info & info, const processed_file & file) {
+	
+	fs::path path = o.output_dir / file.path();
+	boost::system::error_code ec;
+	if(!fs::is_regular_file(path, ec) || fs::file_size(path, ec) != output_size(info, file) || ec) {
+		return false;
 	}
-#endif
 	
-	ifs.seekg(offsets.header_offset);
-	setup::info info;
-	try {
-		info.load(ifs, entries, o.codepage);
-	} catch(const setup::version_error &) {
-		fs::path headerfile = installer;
-		headerfile.replace_extension(".0");
-		if(offsets.header_offset == 0 && headerfile != installer && fs::exists(headerfile)) {
-			log_info << "Opening \"" << color::cyan << headerfile.string() << color::reset << '"';
-			process_file(headerfile, o);
-			return;
+	if(o.existing == SkipExistingByTime) {
+		std::time_t mtime = fs::last_write_time(path, ec);
+		if(ec) {
+			return false;
+		}
+		// Multi-part files get the timestamp of the last part that was written
+		BOOST_FOREACH(boost::uint32_t location, file_locations(file)) {
+			if(file_time(o, info.data_entries[location]) == util::time(mtime)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	util::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+	
+	return ifs.is_open() && check_contents(ifs, info, file) == FileMatches;
+}
+
+//! Add the selected files to a manifest.
+void add_to_manifest(file_manifest & manifest, const setup::info & info, const FilesMap & files) {
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		manifest.add(i.second.path(), info, i.second.entry());
+	}
+}
+
+/*!
+ * Load the manifest of a previous version of an installer.
+ *
+ * \param path Either a manifest file written using \c --write-manifest or an installer.
+ *             The files selected from installers use the same options as the current one.
+ */
+void load_previous_manifest(const fs::path & path, const extract_options & o, file_manifest & manifest) {
+	
+	if(manifest.load(path)) {
+		return;
+	}
+	
+	util::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+	if(!ifs.is_open()) {
+		throw std::runtime_error("Could not open previous installer \"" + path.string() + '"');
+	}
+	
+	loader::offsets offsets;
+	offsets.load(ifs);
+	
+	setup::info::entry_types entries = setup::info::Files | setup::info::Directories
+	                                 | setup::info::DataEntries;
+	if(o.variants == LanguageVariants) {
+		entries |= setup::info::Languages;
+	}
+	if(o.select_components || o.select_tasks) {
+		entries |= setup::info::Components | setup::info::Tasks | setup::info::Types;
+	}
+	if(!o.extract_unknown) {
+		entries |= setup::info::NoUnknownVersion;
+	}
+	
+	ifs.seekg(offsets.header_offset);
+	setup::info info;
+	try {
+		info.load(ifs, entries, o.codepage);
+	} catch(const std::exception & e) {
+		throw format_error("Could not load previous installer \"" + path.string() + "\": " + e.what());
+	}
+	
+	if(o.gog_galaxy) {
+		gog::parse_galaxy_files(info, o.gog);
+	}
+	
+	extract_options options = o;
+	options.silent = true; // Don't report collisions for the previous installer
+	processed_entries processed = filter_variants(options, info);
+	
+	add_to_manifest(manifest, info, processed.files);
+	
+}
+
+/*!
+ * Find files that have not changed since a previous version of an installer.
+ *
+ * \param previous The manifest of the previous version.
+ * \param current  The manifest of the current version.
+ * \param done     Receives the unchanged files.
+ * \param deleted  Receives the paths of files that only exist in the previous version.
+ */
+void skip_unchanged_files(const file_manifest & previous, const file_manifest & current,
+                          const FilesMap & files, std::set<const processed_file *> & done,
+                          std::vector<std::string> & deleted) {
+	
+	size_t unchanged = 0;
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		const std::string * signature = previous.find(i.second.path());
+		if(signature && *signature == *current.find(i.second.path()) && done.insert(&i.second).second) {
+			unchanged++;
+		}
+	}
+	
+	BOOST_FOREACH(const file_manifest::Files::value_type & file, previous.files()) {
+		if(!current.find(file.first)) {
+			deleted.push_back(file.first);
+		}
+	}
+	
+	if(unchanged != 0) {
+		log_info << "Skipping " << unchanged << " unchanged file" << (unchanged == 1 ? "" : "s");
+	}
+	
+}
+
+typedef std::pair<boost::uint32_t, boost::uint32_t> chunk_position;
+
+//! Chunks are identified by their location - sort offsets can still change.
+chunk_position get_chunk_position(const setup::data_entry & data) {
+	return chunk_position(data.chunk.first_slice, data.chunk.offset);
+}
+
+//! \return the first chunk in the group containing a chunk.
+size_t find_chunk_group(const std::vector<size_t> & groups, size_t chunk) {
+	while(groups[chunk] != chunk) {
+		chunk = groups[chunk];
+	}
+	return chunk;
+}
+
+/*!
+ * Select the files for one of several shards that together contain all selected files.
+ *
+ * Chunks are distributed between the shards so that each shard has about the same amount
+ * of compressed data. All chunks containing parts of the same file are kept in the same
+ * shard. The assignment only depends on the installer and the selected files.
+ *
+ * \param o     Options containing the shard to select.
+ * \param info  Setup info for the installer.
+ * \param files Selected files - files from other shards are removed.
+ */
+void select_shard(const extract_options & o, const setup::info & info, FilesMap & files) {
+	
+	std::map<chunk_position, size_t> chunks;
+	std::vector<boost::uint64_t> sizes;
+	std::vector<size_t> groups;
+	BOOST_FOREACH(const setup::data_entry & data, info.data_entries) {
+		if(chunks.insert(std::make_pair(get_chunk_position(data), groups.size())).second) {
+			groups.push_back(groups.size());
+			sizes.push_back(data.chunk.size);
+		}
+	}
+	
+	// Group chunks containing parts of the same file
+	std::set<size_t> used;
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		size_t chunk = chunks[get_chunk_position(info.data_entries[i.second.entry().location])];
+		used.insert(chunk);
+		size_t group = find_chunk_group(groups, chunk);
+		BOOST_FOREACH(boost::uint32_t location, i.second.entry().additional_locations) {
+			size_t part = chunks[get_chunk_position(info.data_entries[location])];
+			used.insert(part);
+			size_t other = find_chunk_group(groups, part);
+			groups[std::max(group, other)] = std::min(group, other);
+			group = std::min(group, other);
+		}
+	}
+	
+	// Only chunks used by selected files count towards the shard sizes
+	std::map<size_t, boost::uint64_t> group_sizes;
+	BOOST_FOREACH(size_t chunk, used) {
+		group_sizes[find_chunk_group(groups, chunk)] += sizes[chunk];
+	}
+	
+	// Assign the largest groups first, each to the shard with the least data so far
+	typedef std::pair<boost::uint64_t, size_t> sized_group;
+	std::vector<sized_group> order;
+	BOOST_FOREACH(const sized_group & group, group_sizes) {
+		order.push_back(sized_group(boost::uint64_t(-1) - group.second, group.first));
+	}
+	std::sort(order.begin(), order.end());
+	std::vector<boost::uint64_t> shard_sizes(o.shards, 0);
+	std::map<size_t, size_t> shard_of_group;
+	BOOST_FOREACH(const sized_group & group, order) {
+		size_t shard = size_t(std::min_element(shard_sizes.begin(), shard_sizes.end()) - shard_sizes.begin());
+		shard_sizes[shard] += boost::uint64_t(-1) - group.first;
+		shard_of_group[group.second] = shard;
+	}
+	
+	size_t total = files.size();
+	for(FilesMap::iterator i = files.begin(); i != files.end();) {
+		size_t chunk = chunks[get_chunk_position(info.data_entries[i->second.entry().location])];
+		if(shard_of_group[find_chunk_group(groups, chunk)] != o.shard) {
+			i = files.erase(i);
+		} else {
+			++i;
+		}
+	}
+	
+	log_info << "Processing shard " << (o.shard + 1) << '/' << o.shards << ": " << files.size()
+	         << " of " << total << " files, " << print_bytes(shard_sizes[o.shard]) << " compressed";
+	
+}
+
+/*!
+ * Make sure there is enough free space in the output directory for all files.
+ *
+ * Space used by existing files that will be overwritten is taken into account, as are
+ * files that will be created as hard links or linked from the store.
+ */
+void check_free_space(const extract_options & o, const setup::info & info, const FilesMap & files,
+                      const content_store * store) {
+	
+	std::set<boost::uint32_t> linked;
+	
+	boost::uint64_t required = 0;
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		if(o.duplicates == HardlinkDuplicates && !i.second.is_multipart()
+		   && !linked.insert(i.second.entry().location).second) {
+			continue;
+		}
+		if(store && !i.second.is_multipart() && store->contains(info.data_entries[i.second.entry().location])) {
+			continue; // Will be linked from the store
+		}
+		boost::uint64_t size = output_size(info, i.second);
+		boost::system::error_code ec;
+		boost::uint64_t existing = fs::file_size(o.output_dir / i.second.path(), ec);
+		if(!ec) {
+			size -= std::min(size, existing);
+		}
+		required += size;
+	}
+	
+	boost::system::error_code ec;
+	fs::space_info space = fs::space(o.output_dir.empty() ? fs::path(".") : o.output_dir, ec);
+	if(ec || space.capacity == 0) {
+		return; // Unknown
+	}
+	
+	if(required > space.available) {
+		std::ostringstream oss;
+		oss << "Not enough free space in ";
+		if(o.output_dir.empty()) {
+			oss << "the current directory";
+		} else {
+			oss << '"' << o.output_dir.string() << '"';
+		}
+		oss << ": " << print_bytes(required) << " required, " << print_bytes(space.available)
+		    << " available";
+		throw std::runtime_error(oss.str());
+	}
+	
+}
+
+void create_output_directory(const extract_options & o) {
+	
+	try {
+		if(!o.output_dir.empty() && !fs::exists(o.output_dir)) {
+			fs::create_directory(o.output_dir);
+		}
+	} catch(...) {
+		throw std::runtime_error("Could not create output directory \"" + o.output_dir.string() + '"');
+	}
+	
+}
+
+typedef std::pair<const processed_file *, boost::uint64_t> output_location;
+typedef std::vector< std::vector<output_location> > LocationOutputs;
+typedef std::map<stream::file, size_t> Files;
+typedef std::map<stream::chunk, Files> Chunks;
+
+/*!
+ * Remove files from the extraction plan.
+ *
+ * Data entries that no longer have any outputs are not added to the chunk list and chunks
+ * that only contain such entries are not decompressed at all.
+ */
+void remove_outputs(LocationOutputs & files_for_location, const std::set<const processed_file *> & files) {
+	
+	if(files.empty()) {
+		return;
+	}
+	
+	BOOST_FOREACH(std::vector<output_location> & outputs, files_for_location) {
+		std::vector<output_location>::iterator end = outputs.begin();
+		BOOST_FOREACH(const output_location & output, outputs) {
+			if(files.find(output.first) == files.end()) {
+				*end++ = output;
+			}
+		}
+		outputs.erase(end, outputs.end());
+	}
+	
+}
+
+//! Find outputs that are already up to date and add them to \c done.
+void skip_existing_files(const extract_options & o, const setup::info & info, const FilesMap & files,
+                         std::set<const processed_file *> & done) {
+	
+	size_t skipped = 0;
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		if(is_up_to_date(o, info, i.second) && done.insert(&i.second).second) {
+			skipped++;
+		}
+	}
+	
+	if(skipped != 0) {
+		log_info << "Skipping " << skipped << " up-to-date file" << (skipped == 1 ? "" : "s");
+	}
+	
+}
+
+//! Create files whose contents are already stored and add them to \c done.
+void link_stored_files(const extract_options & o, const setup::info & info, const content_store & store,
+                       const FilesMap & files, std::set<const processed_file *> & done) {
+	
+	size_t linked = 0;
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		const processed_file & file = i.second;
+		if(!file.is_multipart() && done.find(&file) == done.end()
+		   && store.link(info.data_entries[file.entry().location], o.output_dir / file.path())) {
+			done.insert(&file);
+			linked++;
+		}
+	}
+	
+	if(linked != 0) {
+		log_info << "Linked " << linked << " file" << (linked == 1 ? "" : "s") << " from the store";
+	}
+	
+}
+
+/*!
+ * \return a key identifying the contents of a data entry, or an empty string if the
+ *         checksum is not strong enough to identify identical contents.
+ */
+std::string content_key(const setup::data_entry & data) {
+	
+	const crypto::checksum & checksum = data.file.checksum;
+	std::string digest;
+	switch(checksum.type) {
+		case crypto::MD5:    digest.assign(checksum.md5, sizeof(checksum.md5)); break;
+		case crypto::SHA1:   digest.assign(checksum.sha1, sizeof(checksum.sha1)); break;
+		case crypto::SHA256: digest.assign(checksum.sha256, sizeof(checksum.sha256)); break;
+		default: return std::string();
+	}
+	
+	std::ostringstream oss;
+	oss << int(checksum.type) << ':' << int(data.file.filter) << ':' << data.file.size << ':'
+	    << data.uncompressed_size << ':' << digest;
+	
+	return oss.str();
+}
+
+/*!
+ * Decode data with identical contents only once.
+ *
+ * Data entries with the same checksum, filter and size are merged by moving the outputs of
+ * all but one of them to the remaining entry. The kept entry is chosen from a chunk that
+ * needs to be decompressed anyway if possible, so that chunks only containing duplicate
+ * data are skipped entirely.
+ *
+ * Only single-part files are moved and only entries with a cryptographic checksum are
+ * considered identical.
+ */
+void merge_duplicate_data(const setup::info & info, const std::string & key,
+                          LocationOutputs & files_for_location) {
+	
+	std::set<stream::chunk> required;
+	std::map<std::string, std::vector<size_t> > groups;
+	
+	for(size_t i = 0; i < info.data_entries.size(); i++) {
+		
+		if(files_for_location[i].empty()) {
+			continue;
+		}
+		
+		const setup::data_entry & data = info.data_entries[i];
+		
+		bool mergeable = (data.chunk.encryption == stream::Plaintext || !key.empty());
+		BOOST_FOREACH(const output_location & output, files_for_location[i]) {
+			if(output.first->is_multipart() || output.second != 0) {
+				mergeable = false;
+			}
+		}
+		
+		std::string content = mergeable ? content_key(data) : std::string();
+		if(content.empty()) {
+			required.insert(data.chunk);
+		} else {
+			groups[content].push_back(i);
+		}
+		
+	}
+	
+	typedef std::map<std::string, std::vector<size_t> > Groups;
+	BOOST_FOREACH(const Groups::value_type & group, groups) {
+		if(group.second.size() == 1) {
+			required.insert(info.data_entries[group.second.front()].chunk);
+		}
+	}
+	
+	size_t merged = 0;
+	BOOST_FOREACH(const Groups::value_type & group, groups) {
+		
+		if(group.second.size() == 1) {
+			continue;
+		}
+		
+		// Prefer a chunk that is needed anyway, or else the smallest one
+		size_t kept = group.second.front();
+		BOOST_FOREACH(size_t location, group.second) {
+			const stream::chunk & chunk = info.data_entries[location].chunk;
+			const stream::chunk & best = info.data_entries[kept].chunk;
+			if(required.count(chunk) && !required.count(best)) {
+				kept = location;
+			} else if(required.count(chunk) == required.count(best) && chunk.size < best.size) {
+				kept = location;
+			}
+		}
+		required.insert(info.data_entries[kept].chunk);
+		
+		BOOST_FOREACH(size_t location, group.second) {
+			if(location != kept) {
+				std::vector<output_location> & outputs = files_for_location[location];
+				files_for_location[kept].insert(files_for_location[kept].end(), outputs.begin(), outputs.end());
+				outputs.clear();
+				merged++;
+			}
+		}
+		
+	}
+	
+	if(merged != 0) {
+		debug("[merged " << merged << " data entries with duplicate contents]");
+	}
+	
+}
+
+//! Determine the base names used for external slice files.
+void get_slice_basenames(const fs::path & installer, const setup::info & info,
+                         std::string & basename, std::string & basename2) {
+	
+	basename = util::as_string(installer.stem());
+	basename2 = info.header.base_filename;
+	// Prevent access to unexpected files
+	std::replace(basename2.begin(), basename2.end(), '/', '_');
+	std::replace(basename2.begin(), basename2.end(), '\\', '_');
+	// Older Inno Setup versions used the basename stored in the headers, change our default accordingly
+	if(info.version < INNO_VERSION(4, 1, 7) && !basename2.empty()) {
+		std::swap(basename2, basename);
+	}
+	
+}
+
+//! Number of slice files to check concurrently - this is limited by latency, not bandwidth.
+const size_t slice_check_threads = 8;
+
+/*!
+ * Find the external slice files used by a set of chunks.
+ *
+ * \param validate Check that all slices that will be read exist and have valid headers.
+ *
+ * \return the slice files or \c NULL if the setup data is embedded in the installer.
+ */
+stream::slice_manifest * find_slices(const fs::path & installer, const extract_options & o,
+                                     const loader::offsets & offsets, const setup::info & info,
+                                     const Chunks & chunks, const std::string & key, bool validate) {
+	
+	if(offsets.data_offset || chunks.empty()) {
+		return NULL;
+	}
+	
+	std::set<size_t> needed;
+	size_t count = 0;
+	BOOST_FOREACH(const Chunks::value_type & chunk, chunks) {
+		count = std::max(count, size_t(chunk.first.last_slice) + 1);
+		if(chunk.first.encryption != stream::Plaintext && key.empty()) {
+			continue; // Not read
+		}
+		for(size_t slice = chunk.first.first_slice; slice <= chunk.first.last_slice; slice++) {
+			needed.insert(slice);
+		}
+	}
+	
+	std::string basename, basename2;
+	get_slice_basenames(installer, info, basename, basename2);
+	
+	util::unique_ptr<stream::slice_manifest>::type slices;
+	slices.reset(new stream::slice_manifest(installer.parent_path(), basename, basename2,
+	                                        info.header.slices_per_disk, count));
+	
+	if(validate) {
+		debug("[checking " << needed.size() << " slice files]");
+		std::vector<size_t> list(needed.begin(), needed.end());
+		slices->validate(list, std::max(o.jobs, slice_check_threads));
+	}
+	
+	return slices.release();
+}
+
+/*!
+ * Create a reader for the setup data.
+ *
+ * \param slices Files for the external slices as returned by \ref find_slices() or
+ *               \c NULL to find them as needed.
+ */
+stream::slice_reader * open_slice_reader(const fs::path & installer, const loader::offsets & offsets,
+                                         const setup::info & info, const stream::slice_manifest * slices) {
+	
+	if(offsets.data_offset) {
+		return new stream::slice_reader(installer, offsets.data_offset);
+	}
+	
+	if(slices) {
+		return new stream::slice_reader(*slices);
+	}
+	
+	std::string basename, basename2;
+	get_slice_basenames(installer, info, basename, basename2);
+	
+	return new stream::slice_reader(installer.parent_path(), basename, basename2, info.header.slices_per_disk);
+}
+
+/*!
+ * \return a string identifying the installer for data stored across runs.
+ *
+ * \param slices External slice files containing the setup data, or \c NULL to only
+ *               identify the setup executable.
+ */
+std::string installer_identity(const fs::path & installer, const loader::offsets & offsets,
+                               const stream::slice_manifest * slices = NULL) {
+	
+	std::ostringstream oss;
+	oss << fs::file_size(installer) << ':' << fs::last_write_time(installer);
+	oss << ':' << offsets.header_offset << ':' << offsets.data_offset;
+	
+	if(slices) {
+		for(size_t i = 0; i < slices->size(); i++) {
+			const fs::path & file = slices->file(i);
+			if(file.empty()) {
+				oss << ":-";
+			} else {
+				oss << ':' << fs::file_size(file) << ':' << fs::last_write_time(file);
+			}
+		}
+	}
+	
+	return oss.str();
+}
+
+//! Write a string as a quoted and escaped JSON string.
+void print_json_string(std::ostream & os, const std::string & str) {
+	
+	os << '"';
+	BOOST_FOREACH(char c, str) {
+		switch(c) {
+			case '"':  os << "\\\""; break;
+			case '\\': os << "\\\\"; break;
+			case '\n': os << "\\n"; break;
+			case '\r': os << "\\r"; break;
+			case '\t': os << "\\t"; break;
+			default: {
+				if(boost::uint8_t(c) < 0x20) {
+					os << "\\u00" << std::hex << std::setfill('0') << std::setw(2) << int(c)
+					   << std::setfill(' ') << std::dec;
+				} else {
+					os << c;
+				}
+			}
+		}
+	}
+	os << '"';
+	
+}
+
+//! Cost of decompressing a set of chunks.
+struct plan_cost {
+	
+	size_t chunks;
+	boost::uint64_t compressed_size; //!< Size of the compressed chunks
+	boost::uint64_t decoded_size;    //!< Bytes that need to be decompressed
+	boost::uint64_t discarded_size;  //!< Decompressed bytes not used by any selected file
+	boost::uint32_t dictionary_size; //!< Largest LZMA dictionary size
+	
+	plan_cost() : chunks(0), compressed_size(0), decoded_size(0), discarded_size(0), dictionary_size(0) { }
+	
+	void add(const plan_cost & cost) {
+		chunks += cost.chunks;
+		compressed_size += cost.compressed_size;
+		decoded_size += cost.decoded_size;
+		discarded_size += cost.discarded_size;
+		dictionary_size = std::max(dictionary_size, cost.dictionary_size);
+	}
+	
+	void print(std::ostream & os, const char * separator = ", ") const {
+		os << "\"compressed_size\": " << compressed_size
+		   << separator << "\"decoded_size\": " << decoded_size
+		   << separator << "\"discarded_size\": " << discarded_size
+		   << separator << "\"dictionary_size\": " << dictionary_size;
+	}
+	
+};
+
+/*!
+ * Print the amount of data that needs to be read to process the selected files as JSON.
+ *
+ * Chunks are read sequentially until the end of the last selected file, so the data
+ * before and between selected files in a solid chunk needs to be decompressed and
+ * thrown away. Only the chunk headers are read to determine the LZMA dictionary sizes.
+ */
+void print_plan(std::ostream & os, const fs::path & installer, const loader::offsets & offsets,
+                const setup::info & info, const stream::slice_manifest * slices, const Chunks & chunks,
+                const LocationOutputs & files_for_location) {
+	
+	boost::scoped_ptr<stream::slice_reader> slice_reader;
+	
+	std::set<const processed_file *> files;
+	typedef std::map<stream::compression_method, plan_cost> Methods;
+	Methods methods;
+	plan_cost total;
+	
+	os << "{\n";
+	os << "  \"installer\": ";
+	print_json_string(os, installer.string());
+	os << ",\n  \"chunk_list\": [";
+	
+	bool first = true;
+	BOOST_FOREACH(const Chunks::value_type & chunk, chunks) {
+		
+		plan_cost cost;
+		cost.chunks = 1;
+		cost.compressed_size = chunk.first.size;
+		
+		boost::uint64_t offset = 0;
+		BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+			const stream::file & file = location.first;
+			if(file.offset > offset) {
+				cost.discarded_size += file.offset - offset;
+			}
+			offset = std::max(offset, file.offset + file.size);
+			BOOST_FOREACH(const output_location & output, files_for_location[location.second]) {
+				files.insert(output.first);
+			}
+		}
+		cost.decoded_size = offset;
+		
+		try {
+			if(!slice_reader) {
+				slice_reader.reset(open_slice_reader(installer, offsets, info, slices));
+			}
+			cost.dictionary_size = stream::chunk_reader::dictionary_size(*slice_reader, chunk.first);
+		} catch(const std::exception & e) {
+			// Other chunks may be stored in slices that can still be read
+			log_warning << "Could not read header of chunk at slice " << chunk.first.first_slice
+			            << " offset " << print_hex(chunk.first.offset) << ": " << e.what();
+			slice_reader.reset();
+		}
+		
+		os << (first ? "\n" : ",\n") << "    { \"slice\": " << chunk.first.first_slice
+		   << ", \"offset\": " << chunk.first.offset
+		   << ", \"compression\": \"" << chunk.first.compression << '"'
+		   << ", \"encrypted\": " << (chunk.first.encryption != stream::Plaintext ? "true" : "false")
+		   << ", \"data_entries\": " << chunk.second.size() << ", ";
+		cost.print(os);
+		os << " }";
+		first = false;
+		
+		methods[chunk.first.compression].add(cost);
+		total.add(cost);
+	}
+	
+	os << (first ? "],\n" : "\n  ],\n");
+	
+	os << "  \"methods\": {";
+	first = true;
+	BOOST_FOREACH(const Methods::value_type & method, methods) {
+		os << (first ? "\n" : ",\n") << "    \"" << method.first << "\": { ";
+		os << "\"chunks\": " << method.second.chunks << ", ";
+		method.second.print(os);
+		os << " }";
+		first = false;
+	}
+	os << (first ? "},\n" : "\n  },\n");
+	
+	os << "  \"files\": " << files.size() << ",\n";
+	os << "  \"chunks\": " << total.chunks << ",\n  ";
+	total.print(os, ",\n  ");
+	os << "\n}\n";
+	
+}
+
+typedef std::pair<file_output *, boost::uint64_t> file_output_location;
+
+//! Write a block of data to all outputs of a file.
+void write_outputs(std::vector<file_output_location> & outputs, boost::uint64_t offset,
+                   const char * data, size_t size) {
+	BOOST_FOREACH(file_output_location & out, outputs) {
+		file_output * output = out.first;
+		output->seek(out.second + offset);
+		bool success = output->write(data, size);
+		if(!success) {
+			throw std::runtime_error("Error writing file \"" + output->path().string() + '"');
+		}
+	}
+}
+
+void update_progress(progress & extract_progress, boost::uint64_t delta) {
+	util::scoped_lock<util::recursive_mutex> lock(logger::output_mutex);
+	extract_progress.update(delta);
+}
+
+//! Location in the slice files corresponding to a position in the data of a stored chunk.
+struct stored_position {
+	
+	size_t slice;
+	boost::uint32_t offset;
+	boost::uint64_t position; //!< Position in the chunk data.
+	
+};
+
+//! Feeds data copied directly from the slice files to the checksums and progress.
+class stored_data_observer : public util::file_copier::observer {
+	
+	crypto::hasher & hasher;
+	std::vector<file_output_location> & outputs;
+	progress & extract_progress;
+	boost::uint64_t offset;
+	
+public:
+	
+	stored_data_observer(crypto::hasher & data_hasher, std::vector<file_output_location> & file_outputs,
+	                     progress & shared_progress)
+		: hasher(data_hasher), outputs(file_outputs), extract_progress(shared_progress), offset(0)
+	{ }
+	
+	void update(const char * data, size_t size) {
+		hasher.update(data, size);
+		BOOST_FOREACH(file_output_location & out, outputs) {
+			out.first->written(out.second + offset, data, size);
+		}
+		update_progress(extract_progress, size);
+		offset += size;
+	}
+	
+};
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+
+/*!
+ * Writes and hashes file data on a separate thread.
+ *
+ * Decompressed data is passed to the writer thread through a bounded ring of reusable
+ * buffers. This way decompression and output overlap and a large file is processed at the
+ * speed of the slower stage instead of the sum of both.
+ */
+class output_pipeline : private boost::noncopyable {
+	
+	struct block {
+		std::vector<char> data;
+		size_t size;
+		boost::uint64_t offset;
+	};
+	
+	std::vector<block> blocks;
+	size_t first;  //!< Index of the oldest block waiting to be written.
+	size_t filled; //!< Number of blocks waiting to be written.
+	bool stop;
+	std::exception_ptr error;
+	
+	std::vector<file_output_location> * outputs;
+	progress & extract_progress;
+	output_capture * capture; //!< Output capture of the thread that created the pipeline.
+	
+	std::mutex mutex;
+	std::condition_variable block_filled;
+	std::condition_variable block_written;
+	
+	std::thread writer;
+	
+	void run();
+	
+public:
+	
+	static const size_t block_size = 8192 * 10;
+	static const size_t block_count = 16;
+	
+	explicit output_pipeline(progress & shared_progress);
+	
+	~output_pipeline();
+	
+	//! Set the outputs for the following blocks. There must be no blocks in flight.
+	void begin(std::vector<file_output_location> & file_outputs) {
+		outputs = &file_outputs;
+	}
+	
+	/*!
+	 * Get the next free buffer, waiting for the writer if there is none.
+	 *
+	 * \return a buffer with room for \ref block_size bytes.
+	 */
+	char * acquire();
+	
+	//! Queue the buffer returned by the last \ref acquire() call for writing.
+	void push(size_t size, boost::uint64_t offset);
+	
+	//! Wait until all queued blocks have been written.
+	void wait();
+	
+	//! Wait until all queued blocks have been written and re-throw any write errors.
+	void finish();
+	
+};
+
+output_pipeline::output_pipeline(progress & shared_progress)
+	: blocks(block_count), first(0), filled(0), stop(false)
+	, outputs(NULL), extract_progress(shared_progress), capture(output_capture::current())
+{
+	BOOST_FOREACH(block & b, blocks) {
+		b.data.resize(block_size);
+	}
+	writer = std::thread(&output_pipeline::run, this);
+}
+
+output_pipeline::~output_pipeline() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	block_filled.notify_one();
+	writer.join();
+}
+
+void output_pipeline::run() {
+	
+	output_capture::scope redirect(capture);
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	
+	for(;;) {
+		
+		while(filled == 0 && !stop) {
+			block_filled.wait(lock);
+		}
+		if(filled == 0) {
+			break;
+		}
+		
+		const block & current = blocks[first];
+		bool failed = bool(error);
+		lock.unlock();
+		
+		std::exception_ptr write_error;
+		if(!failed) {
+			try {
+				write_outputs(*outputs, current.offset, &current.data[0], current.size);
+				update_progress(extract_progress, current.size);
+			} catch(...) {
+				write_error = std::current_exception();
+			}
+		}
+		
+		lock.lock();
+		if(write_error && !error) {
+			error = write_error;
+		}
+		first = (first + 1) % blocks.size();
+		filled--;
+		block_written.notify_one();
+		
+	}
+	
+}
+
+char * output_pipeline::acquire() {
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	
+	while(filled == blocks.size()) {
+		block_written.wait(lock);
+	}
+	
+	return &blocks[(first + filled) % blocks.size()].data[0];
+}
+
+void output_pipeline::push(size_t size, boost::uint64_t offset) {
+	
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		block & next = blocks[(first + filled) % blocks.size()];
+		next.size = size;
+		next.offset = offset;
+		filled++;
+	}
+	
+	block_filled.notify_one();
+}
+
+void output_pipeline::wait() {
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	
+	while(filled != 0) {
+		block_written.wait(lock);
+	}
+}
+
+void output_pipeline::finish() {
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	
+	while(filled != 0) {
+		block_written.wait(lock);
+	}
+	
+	if(error) {
+		std::exception_ptr e = error;
+		error = std::exception_ptr();
+		std::rethrow_exception(e);
+	}
+}
+
+#endif // INNOEXTRACT_HAVE_STD_THREAD
+
+//! Lists, tests and/or extracts the files contained in chunks.
+class chunk_extractor : private boost::noncopyable {
+	
+	const fs::path & installer;
+	const extract_options & o;
+	const setup::info & info;
+	const loader::offsets & offsets;
+	const stream::slice_manifest * slices;
+	const std::string & key;
+	const LocationOutputs & files_for_location;
+	progress & extract_progress;
+	stream::seek_index * index;
+	extract_journal * journal;
+	const content_store * store;
+	
+	typedef boost::ptr_map<const processed_file *, file_output> multi_part_outputs;
+	multi_part_outputs multi_outputs;
+	
+	std::set<const processed_file *> streamed_files; //!< Multi-part files written to o.sink
+	boost::scoped_ptr<stream::slice_reader> part_reader; //!< Reader for streaming multi-part files
+	
+	util::file_copier copier; //!< Copies stored data directly from the slice files
+	
+	#if INNOEXTRACT_HAVE_STD_THREAD
+	boost::scoped_ptr<output_pipeline> pipeline;
+	boost::uint64_t copy_data_pipelined(std::istream & source, std::vector<file_output_location> & outputs);
+	#endif
+	
+	/*!
+	 * Copy file data to all outputs.
+	 *
+	 * \return the number of bytes copied.
+	 */
+	boost::uint64_t copy_data(std::istream & source, std::vector<file_output_location> & outputs,
+	                          boost::uint64_t size);
+	
+	//! \return true if the files in a chunk can be copied directly from the slice files.
+	bool can_copy_directly(const Chunks::value_type & chunk) const;
+	
+	/*!
+	 * Copy a file from a stored chunk directly from the slice files to all outputs.
+	 *
+	 * \param reader   Reader used to locate the data in the slice files.
+	 * \param stored   Location of the chunk data preceding the file - updated to point
+	 *                 after the file.
+	 * \param file     The file to copy.
+	 * \param outputs  Outputs to write the file to.
+	 * \param checksum Receives the checksum of the file data.
+	 *
+	 * \return \c false if the data could not be copied directly. In that case nothing has been
+	 *         written to the outputs, but \c stored is no longer valid.
+	 */
+	bool copy_stored(stream::slice_reader & reader, stored_position & stored, const stream::file & file,
+	                 std::vector<file_output_location> & outputs, crypto::checksum & checksum);
+	
+	//! \return true if all outputs for a data entry have been extracted by a previous run.
+	bool is_extracted(const std::vector<output_location> & outputs) const;
+	
+	//! Record a completely written and verified output file in the journal.
+	void record_extracted(const processed_file & fileinfo);
+	
+	/*!
+	 * Write all parts of a multi-part file to \c o.sink.
+	 *
+	 * Sinks can only be written sequentially, so instead of waiting for the remaining parts
+	 * to come up in the current chunk order, all parts are read using a separate slice reader.
+	 */
+	void stream_multipart_file(const processed_file & fileinfo);
+	
+	/*!
+	 * Verify the output checksum of a completely written file.
+	 *
+	 * \param output The completely written file.
+	 * \param copies Files with the same contents that should be checked against the same
+	 *               checksum.
+	 */
+	void verify_output(file_output & output, const std::vector<const processed_file *> & copies);
+	
+	//! Report a mismatch between the checksum of an output file and the expected one.
+	void check_output_checksum(const processed_file & file, const crypto::checksum & actual);
+	
+	/*!
+	 * Create files with the same contents as a completely written output file.
+	 *
+	 * The files are created according to \c o.duplicates.
+	 */
+	void create_copies(const file_output & output, const std::vector<const processed_file *> & copies);
+	
+public:
+	
+	chunk_extractor(const fs::path & installer_path, const extract_options & options,
+	                const setup::info & setup_info, const loader::offsets & setup_offsets,
+	                const stream::slice_manifest * slice_files,
+	                const std::string & password_key, const LocationOutputs & outputs,
+	                progress & shared_progress, stream::seek_index * seek_index,
+	                extract_journal * extracted, const content_store * contents)
+		: installer(installer_path), o(options), info(setup_info), offsets(setup_offsets), slices(slice_files)
+		, key(password_key), files_for_location(outputs), extract_progress(shared_progress)
+		, index(seek_index), journal(extracted), store(contents)
+	{ }
+	
+	/*!
+	 * Process all files in a chunk.
+	 *
+	 * Outputs for multi-part files are kept open until all their parts have been processed
+	 * by the same extractor.
+	 *
+	 * \param slice_reader Reader for the setup data or \c NULL if files are only listed.
+	 * \param chunk        The chunk and the data entries to process from it.
+	 */
+	void process(stream::slice_reader * slice_reader, const Chunks::value_type & chunk);
+	
+	//! \return true if any multi-part file has not been completely written.
+	bool has_incomplete_files() const { return !multi_outputs.empty(); }
+	
+};
+
+void chunk_extractor::process(stream::slice_reader * slice_reader, const Chunks::value_type & chunk) {
+	
+	
+	debug("[starting " << chunk.first.compression << " chunk @ slice " << chunk.first.first_slice
+	      << " + " << print_hex(offsets.data_offset) << " + " << print_hex(chunk.first.offset)
+	      << ']');
+	
+	bool reading = (o.extract || o.test)
+	               && (chunk.first.encryption == stream::Plaintext || !key.empty());
+	
+	if(reading && journal) {
+		boost::uint64_t extracted = 0;
+		BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+			if(!is_extracted(files_for_location[location.second])) {
+				extracted = boost::uint64_t(-1);
+				break;
+			}
+			extracted += info.data_entries[location.second].uncompressed_size;
+		}
+		if(extracted != boost::uint64_t(-1)) {
+			debug("[skipping chunk extracted by a previous run]");
+			update_progress(extract_progress, extracted);
+			reading = false;
+		}
+	}
+	
+	// Stored data is copied directly from the slice files if possible
+	stored_position stored = { chunk.first.first_slice, chunk.first.offset, 0 };
+	bool direct = false;
+	
+	boost::uint64_t chunk_size = 0; // Decompressed bytes needed from the chunk
+	BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+		chunk_size = std::max(chunk_size, location.first.offset + location.first.size);
+	}
+	
+	boost::uint64_t chunk_offset = 0; // Read position of chunk_source
+	stream::chunk_reader::pointer chunk_source;
+	if(reading) {
+		chunk_source = stream::chunk_reader::get(*slice_reader, chunk.first, key, index, chunk_offset,
+		                                         chunk_size);
+		if(can_copy_directly(chunk)) {
+			// Skip the chunk magic
+			direct = slice_reader->locate(stored.slice, stored.offset, 4, NULL);
+		}
+		if(direct) {
+			chunk_source.reset();
+		}
+	}
+	boost::uint64_t offset = 0;
+	
+	BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+		const stream::file & file = location.first;
+		const std::vector<output_location> & output_locations = files_for_location[location.second];
+		
+		// Print filename and size
+		if(o.list) {
+			
+			util::scoped_lock<util::recursive_mutex> lock(logger::output_mutex);
+			
+			extract_progress.clear(DeferredClear);
+			
+			if(!o.silent) {
+				
+				bool named = false;
+				boost::uint64_t size = 0;
+				const crypto::checksum * checksum = NULL;
+				BOOST_FOREACH(const output_location & output, output_locations) {
+					if(output.second != 0) {
+						continue;
+					}
+					bool mismatch = false;
+					if(output.first->entry().size != 0) {
+						if(size != 0 && size != output.first->entry().size) {
+							mismatch = true;
+						}
+						size = output.first->entry().size;
+					}
+					if(output.first->entry().checksum.type != crypto::None) {
+						if(checksum && *checksum != output.first->entry().checksum) {
+							mismatch = true;
+						}
+						checksum = &output.first->entry().checksum;
+					}
+					if(mismatch) {
+						// Different file even though the starting location is the same
+						if(named) {
+							print_file_details(o, file, chunk.first, size, checksum, key);
+							named = false;
+						}
+					}
+					if(named) {
+						std::cout << ", ";
+					} else {
+						std::cout << " - ";
+						named = true;
+					}
+					if(chunk.first.encryption != stream::Plaintext) {
+						if(key.empty()) {
+							std::cout << '"' << color::dim_yellow << output.first->path() << color::reset << '"';
+						} else {
+							std::cout << '"' << color::yellow << output.first->path() << color::reset << '"';
+						}
+					} else {
+						std::cout << '"' << color::white << output.first->path() << color::reset << '"';
+					}
+					print_filter_info(output.first->entry());
+				}
+				
+				if(named) {
+					print_file_details(o, file, chunk.first, size, checksum, key);
+				}
+				
+			} else {
+				BOOST_FOREACH(const output_location & output, output_locations) {
+					if(output.second == 0) {
+						const processed_file * fileinfo = output.first;
+						if(o.list_sizes) {
+							boost::uint64_t size = fileinfo->entry().size;
+							std::cout << color::dim_cyan << (size != 0 ? size : file.size) << color::reset << ' ';
+						}
+						if(o.list_checksums) {
+							print_checksum_info(file, &fileinfo->entry().checksum);
+							std::cout << ' ';
+						}
+						std::cout << color::white << fileinfo->path() << color::reset << '\n';
+					}
+				}
+			}
+			
+			bool updated = extract_progress.update(0, true);
+			if(!updated && (o.extract || o.test)) {
+				std::cout.flush();
+			}
+			
+		}
+		
+		// Seek to the correct position within the chunk
+		if(reading && file.offset < offset) {
+			std::ostringstream oss;
+			oss << "Bad offset while extracting files: file start (" << file.offset
+			    << ") is before end of previous file (" << offset << ")!";
+			throw format_error(oss.str());
+		}
+		offset = file.offset + file.size;
+		
+		if(!reading) {
+			continue; // Not extracting/testing this file
+		}
+		
+		const setup::data_entry & data = info.data_entries[location.second];
+		
+		if(is_extracted(output_locations)) {
+			update_progress(extract_progress, data.uncompressed_size);
+			continue;
+		}
+		
+		// Open output files
+		boost::ptr_vector<file_output> single_outputs;
+		std::vector<file_output_location> outputs;
+		std::vector<const processed_file *> links;
+		BOOST_FOREACH(const output_location & output_loc, output_locations) {
+			const processed_file * fileinfo = output_loc.first;
+			try {
+				
+				if(!o.extract && fileinfo->entry().checksum.type == crypto::None) {
+					continue;
+				}
+				
+				if(o.sink) {
+					if(fileinfo->is_multipart()) {
+						if(streamed_files.insert(fileinfo).second) {
+							stream_multipart_file(*fileinfo);
+						}
+					} else if(!single_outputs.empty()) {
+						// Store duplicates as links so that the data is only written once
+						links.push_back(fileinfo);
+					} else {
+						boost::uint32_t nsec = o.preserve_file_times ? data.timestamp_nsec : 0;
+						file_output * output = new file_output(fileinfo, *o.sink, data.uncompressed_size,
+						                                       file_time(o, data), nsec);
+						single_outputs.push_back(output);
+						outputs.push_back(file_output_location(output, output_loc.second));
+					}
+					continue;
+				}
+				
+				// Re-use existing file output for multi-part files
+				file_output * output = NULL;
+				if(fileinfo->is_multipart()) {
+					multi_part_outputs::iterator it = multi_outputs.find(fileinfo);
+					if(it != multi_outputs.end()) {
+						output = it->second;
+					}
+				}
+				
+				if(!output && !fileinfo->is_multipart() && !single_outputs.empty()
+				   && o.extract && o.duplicates != WriteDuplicates) {
+					// Create the file from the first output once that is complete
+					links.push_back(fileinfo);
+					continue;
+				}
+				
+				if(!output) {
+					output = new file_output(o.output_dir, fileinfo, o.extract, output_size(info, *fileinfo));
+					if(o.drop_cache) {
+						output->limit_cache();
+					}
+					if(fileinfo->is_multipart()) {
+						multi_outputs.insert(fileinfo, output);
+					} else {
+						single_outputs.push_back(output);
+					}
+				}
+				
+				outputs.push_back(file_output_location(output, output_loc.second));
+				
+			} catch(boost::bad_pointer &) {
+				// should never happen
+				std::terminate();
+			}
+		}
+		
+		if(o.sink && outputs.empty()) {
+			continue; // All outputs for this data have already been streamed
+		}
+		
+		crypto::checksum checksum;
+		boost::uint64_t output_size = file.size;
+		
+		if(!direct || !copy_stored(*slice_reader, stored, file, outputs, checksum)) {
+			
+			stream::seek_index::checkpoint checkpoint;
+			if(!chunk_source.get()) {
+				// Continue reading the chunk normally
+				direct = false;
+			} else if(index && file.offset > chunk_offset
+			          && index->find(chunk.first, file.offset, checkpoint)
+			          && checkpoint.output > chunk_offset) {
+				chunk_source.reset(); // Restart at the checkpoint
+			}
+			if(!chunk_source.get()) {
+				chunk_offset = file.offset;
+				chunk_source = stream::chunk_reader::get(*slice_reader, chunk.first, key, index, chunk_offset,
+				                                         chunk_size);
+				if(chunk_offset != 0) {
+					debug("[resuming chunk @ " << print_hex(chunk_offset) << ']');
+				}
+			}
+			
+			if(file.offset > chunk_offset) {
+				debug("discarding " << print_bytes(file.offset - chunk_offset)
+				      << " @ " << print_hex(chunk_offset));
+				util::discard(*chunk_source, file.offset - chunk_offset);
+			}
+			
+			// Open input file
+			stream::file_reader::pointer file_source;
+			file_source = stream::file_reader::get(*chunk_source, file, &checksum);
+			
+			// Copy data
+			output_size = copy_data(*file_source, outputs, file.size);
+			chunk_offset = file.offset + file.size;
+			
+		}
+		
+		if(output_size != data.uncompressed_size) {
+			log_warning << "Unexpected output file size: " << output_size << " != " << data.uncompressed_size;
+		}
+		
+		util::time filetime = file_time(o, data);
+		
+		const std::vector<const processed_file *> no_copies;
+		std::vector<const processed_file *> finished;
+		
+		BOOST_FOREACH(file_output_location & out, outputs) {
+			file_output * output = out.first;
+			
+			if(!output || (output->file()->is_multipart() && !output->is_complete())) {
+				continue;
+			}
+			
+			// Files that are created from this output instead of writing the data again
+			const std::vector<const processed_file *> & copies = output->file()->is_multipart()
+			                                                   ? no_copies : links;
+			
+			verify_output(*output, copies);
+			
+			if(o.sink) {
+				output->close();
+				BOOST_FOREACH(const processed_file * link, copies) {
+					o.sink->add_link(link->path(), output->file()->path(), filetime);
+				}
+			} else if(o.extract) {
+				if(o.preserve_file_times || !copies.empty() || store) {
+					output->close();
+				}
+				if(o.preserve_file_times) {
+					// Adjust file timestamps - single-part files may have been merged from other data entries
+					const setup::data_entry & own = output->file()->is_multipart()
+					                                ? data : info.data_entries[output->file()->entry().location];
+					if(!util::set_file_time(output->path(), file_time(o, own), own.timestamp_nsec)) {
+						log_warning << "Error setting timestamp on file " << output->path();
+					}
+				}
+				create_copies(*output, copies);
+				finished.push_back(output->file());
+				finished.insert(finished.end(), copies.begin(), copies.end());
+			}
+			
+			BOOST_FOREACH(file_output_location & other, outputs) {
+				if(other.first == output) {
+					other.first = NULL;
+				}
+			}
+			
+			if(output->file()->is_multipart()) {
+				debug("[finalizing multi-part file]");
+				multi_outputs.erase(output->file());
+			}
+			
+		}
+		
+		// Verify checksums
+		if(checksum != file.checksum) {
+			log_warning << "Checksum mismatch:\n"
+			            << " ├─ actual:   " << checksum << '\n'
+			            << " └─ expected: " << file.checksum;
+			if(o.test) {
+				throw std::runtime_error("Integrity test failed!");
+			}
+		} else {
+			BOOST_FOREACH(const processed_file * fileinfo, finished) {
+				if(store && !fileinfo->is_multipart()) {
+					store->add(info.data_entries[fileinfo->entry().location], o.output_dir / fileinfo->path());
+				}
+				record_extracted(*fileinfo);
+			}
+		}
+		
+	}
+	
+	if(reading && o.drop_cache) {
+		// Release the chunk data, including the magic, from the page cache
+		std::vector<stream::slice_reader::extent> extents;
+		if(slice_reader->find_extents(chunk.first.first_slice, chunk.first.offset, chunk.first.size + 4,
+		                              extents)) {
+			BOOST_FOREACH(const stream::slice_reader::extent & extent, extents) {
+				util::drop_cache(extent.file, extent.offset, extent.size);
+			}
+		}
+	}
+	
+	#ifdef DEBUG
+	if(offset < chunk.first.size) {
+		debug("discarding " << print_bytes(chunk.first.size - offset)
+		      << " at end of chunk @ " << print_hex(offset));
+	}
+	#endif
+}
+
+bool chunk_extractor::is_extracted(const std::vector<output_location> & outputs) const {
+	
+	if(!journal || outputs.empty()) {
+		return false;
+	}
+	
+	BOOST_FOREACH(const output_location & output, outputs) {
+		const processed_file & fileinfo = *output.first;
+		const setup::data_entry & data = info.data_entries[fileinfo.entry().location];
+		if(!journal->is_complete(fileinfo.path(), output_size(info, fileinfo), data.file.checksum)) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+void chunk_extractor::record_extracted(const processed_file & fileinfo) {
+	
+	if(journal) {
+		const setup::data_entry & data = info.data_entries[fileinfo.entry().location];
+		journal->record(fileinfo.path(), output_size(info, fileinfo), data.file.checksum);
+	}
+	
+}
+
+bool chunk_extractor::can_copy_directly(const Chunks::value_type & chunk) const {
+	
+	if(!o.extract || o.sink || chunk.first.compression != stream::Stored
+	   || chunk.first.encryption != stream::Plaintext) {
+		return false;
+	}
+	
+	BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+		if(location.first.filter != stream::NoFilter) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+bool chunk_extractor::copy_stored(stream::slice_reader & reader, stored_position & stored,
+                                  const stream::file & file, std::vector<file_output_location> & outputs,
+                                  crypto::checksum & checksum) {
+	
+	std::vector<util::file_copier::target> targets;
+	BOOST_FOREACH(const file_output_location & out, outputs) {
+		const fs::path * path = out.first->direct_path();
+		if(!path) {
+			return false;
+		}
+		targets.push_back(util::file_copier::target(*path, out.second));
+	}
+	
+	std::vector<stream::slice_reader::extent> extents;
+	if(!reader.locate(stored.slice, stored.offset, file.offset - stored.position, NULL)
+	   || !reader.locate(stored.slice, stored.offset, file.size, &extents)) {
+		return false;
+	}
+	stored.position = file.offset + file.size;
+	
+	if(!extents.empty() && !copier.open_source(extents.front().file)) {
+		return false;
+	}
+	
+	debug("copying " << print_bytes(file.size) << " directly from " << extents.size() << " extent(s)");
+	
+	crypto::hasher hasher(file.checksum.type);
+	stored_data_observer observer(hasher, outputs, extract_progress);
+	BOOST_FOREACH(const stream::slice_reader::extent & extent, extents) {
+		if(!copier.open_source(extent.file)
+		   || !copier.copy(extent.offset, extent.size, targets, &observer)) {
+			throw std::runtime_error("Error writing file \"" + outputs.front().first->path().string() + '"');
+		}
+	}
+	
+	BOOST_FOREACH(file_output_location & out, outputs) {
+		out.first->seek(out.second + file.size);
+	}
+	
+	checksum = hasher.finalize();
+	
+	return true;
+}
+
+void chunk_extractor::verify_output(file_output & output,
+                                    const std::vector<const processed_file *> & copies) {
+	
+	crypto::checksum_type type = output.file()->entry().checksum.type;
+	
+	std::vector<const processed_file *> files;
+	crypto::checksum output_checksum;
+	if(type != crypto::None && output.calculate_checksum()) {
+		output_checksum = output.checksum();
+		files.push_back(output.file());
+	}
+	
+	BOOST_FOREACH(const processed_file * copy, copies) {
+		crypto::checksum_type copy_type = copy->entry().checksum.type;
+		if(copy_type == crypto::None) {
+			continue;
+		} else if(!files.empty() && copy_type == type) {
+			files.push_back(copy);
+			continue;
+		}
+		// Duplicates may have been stored with a different checksum type
+		crypto::checksum copy_checksum;
+		if(output.calculate_checksum(copy_type, copy_checksum)) {
+			check_output_checksum(*copy, copy_checksum);
+		} else {
+			log_warning << "Could not verify " << copy->path() << ": " << copy_type
+			            << " checksum not available for " << output.file()->path();
+		}
+	}
+	
+	BOOST_FOREACH(const processed_file * file, files) {
+		check_output_checksum(*file, output_checksum);
+	}
+	
+}
+
+void chunk_extractor::check_output_checksum(const processed_file & file,
+                                            const crypto::checksum & actual) {
+	
+	if(actual != file.entry().checksum) {
+		log_warning << "Output checksum mismatch for " << file.path() << ":\n"
+		            << " ├─ actual:   " << actual << '\n'
+		            << " └─ expected: " << file.entry().checksum;
+		if(o.test) {
+			throw std::runtime_error("Integrity test failed!");
+		}
+	}
+	
+}
+
+void chunk_extractor::create_copies(const file_output & output,
+                                    const std::vector<const processed_file *> & copies) {
+	
+	util::clone_method method = util::CloneCopy;
+	if(o.duplicates == ReflinkDuplicates) {
+		method = util::CloneReflink;
+	} else if(o.duplicates == HardlinkDuplicates) {
+		method = util::CloneHardlink;
+	}
+	
+	BOOST_FOREACH(const processed_file * copy, copies) {
+		
+		fs::path path = o.output_dir / copy->path();
+		if(!util::clone_file(output.path(), path, method)) {
+			throw std::runtime_error("Could not create \"" + path.string() + "\" from \""
+			                         + output.path().string() + '"');
+		}
+		
+		if(o.preserve_file_times) {
+			const setup::data_entry & data = info.data_entries[copy->entry().location];
+			if(!util::set_file_time(path, file_time(o, data), data.timestamp_nsec)) {
+				log_warning << "Error setting timestamp on file " << path;
+			}
+		}
+		
+	}
+	
+}
+
+void chunk_extractor::stream_multipart_file(const processed_file & fileinfo) {
+	
+	std::vector<boost::uint32_t> locations;
+	locations.push_back(fileinfo.entry().location);
+	locations.insert(locations.end(), fileinfo.entry().additional_locations.begin(),
+	                 fileinfo.entry().additional_locations.end());
+	
+	boost::uint64_t size = 0;
+	BOOST_FOREACH(boost::uint32_t location, locations) {
+		const setup::data_entry & data = info.data_entries[location];
+		if(data.chunk.encryption != stream::Plaintext && key.empty()) {
+			return; // Cannot decrypt this file
+		}
+		size += data.uncompressed_size;
+	}
+	
+	debug("[streaming multi-part file " << fileinfo.path() << ']');
+	
+	const setup::data_entry & first = info.data_entries[locations.front()];
+	boost::uint32_t nsec = o.preserve_file_times ? first.timestamp_nsec : 0;
+	file_output output(&fileinfo, *o.sink, size, file_time(o, first), nsec);
+	
+	std::vector<file_output_location> outputs(1, file_output_location(&output, 0));
+	BOOST_FOREACH(boost::uint32_t location, locations) {
+		
+		const setup::data_entry & data = info.data_entries[location];
+		
+		if(!part_reader) {
+			part_reader.reset(open_slice_reader(installer, offsets, info, slices));
+		}
+		boost::uint64_t chunk_offset = data.file.offset;
+		stream::chunk_reader::pointer chunk_source;
+		chunk_source = stream::chunk_reader::get(*part_reader, data.chunk, key, index, chunk_offset,
+		                                         data.file.offset + data.file.size);
+		util::discard(*chunk_source, data.file.offset - chunk_offset);
+		
+		crypto::checksum checksum;
+		stream::file_reader::pointer file_source;
+		file_source = stream::file_reader::get(*chunk_source, data.file, &checksum);
+		
+		boost::uint64_t output_size = copy_data(*file_source, outputs, data.file.size);
+		if(output_size != data.uncompressed_size) {
+			log_warning << "Unexpected output file size: " << output_size << " != " << data.uncompressed_size;
+		}
+		outputs.front().second += output_size;
+		
+		if(checksum != data.file.checksum) {
+			log_warning << "Checksum mismatch:\n"
+			            << " ├─ actual:   " << checksum << '\n'
+			            << " └─ expected: " << data.file.checksum;
+		}
+		
+	}
+	
+	verify_output(output, std::vector<const processed_file *>());
+	output.close();
+	
+}
+
+boost::uint64_t chunk_extractor::copy_data(std::istream & source, std::vector<file_output_location> & outputs,
+                                           boost::uint64_t size) {
+	
+	#if INNOEXTRACT_HAVE_STD_THREAD
+	if(size > output_pipeline::block_size) {
+		return copy_data_pipelined(source, outputs);
+	}
+	#else
+	(void)size;
+	#endif
+	
+	boost::uint64_t output_size = 0;
+	while(!source.eof()) {
+		char buffer[8192 * 10];
+		std::streamsize buffer_size = std::streamsize(boost::size(buffer));
+		std::streamsize n = source.read(buffer, buffer_size).gcount();
+		if(n > 0) {
+			write_outputs(outputs, output_size, buffer, size_t(n));
+			update_progress(extract_progress, boost::uint64_t(n));
+			output_size += boost::uint64_t(n);
+		}
+	}
+	
+	return output_size;
+}
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+
+boost::uint64_t chunk_extractor::copy_data_pipelined(std::istream & source,
+                                                     std::vector<file_output_location> & outputs) {
+	
+	if(!pipeline) {
+		pipeline.reset(new output_pipeline(extract_progress));
+	}
+	
+	pipeline->begin(outputs);
+	
+	boost::uint64_t output_size = 0;
+	try {
+		while(!source.eof()) {
+			char * buffer = pipeline->acquire();
+			std::streamsize buffer_size = std::streamsize(output_pipeline::block_size);
+			std::streamsize n = source.read(buffer, buffer_size).gcount();
+			if(n > 0) {
+				pipeline->push(size_t(n), output_size);
+				output_size += boost::uint64_t(n);
+			}
+		}
+	} catch(...) {
+		// Don't leave blocks referencing the outputs in flight
+		pipeline->wait();
+		throw;
+	}
+	
+	pipeline->finish();
+	
+	return output_size;
+}
+
+#endif // INNOEXTRACT_HAVE_STD_THREAD
+
+//! A set of chunks that must be processed in order by the same \ref chunk_extractor.
+struct chunk_group {
+	
+	std::vector<Chunks::const_iterator> chunks;
+	
+	boost::uint64_t size; //!< Total compressed size of the chunks.
+	
+	boost::uint64_t device; //!< Device storing most of the data, or \c 0 if unknown.
+	
+	chunk_group() : size(0), device(0) { }
+	
+	//! Order larger groups first.
+	bool operator<(const chunk_group & other) const {
+		return size > other.size;
+	}
+	
+};
+
+/*!
+ * Split chunks into groups that can be processed independently.
+ *
+ * Chunks sharing parts of a multi-part file are put into the same group.
+ * The returned groups are sorted by descending size so that the most expensive ones are
+ * started first.
+ */
+std::vector<chunk_group> group_chunks(const Chunks & chunks, const setup::info & info,
+                                      const FilesMap & files) {
+	
+	std::vector<size_t> chunk_of_location(info.data_entries.size(), size_t(-1));
+	std::vector<size_t> parent;
+	parent.reserve(chunks.size());
+	BOOST_FOREACH(const Chunks::value_type & chunk, chunks) {
+		BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+			chunk_of_location[location.second] = parent.size();
+		}
+		parent.push_back(parent.size());
+	}
+	
+	// Join the chunks containing parts of the same file
+	BOOST_FOREACH(const FilesMap::value_type & i, files) {
+		const processed_file & file = i.second;
+		BOOST_FOREACH(boost::uint32_t location, file.entry().additional_locations) {
+			size_t a = chunk_of_location[file.entry().location];
+			size_t b = chunk_of_location[location];
+			if(a == size_t(-1) || b == size_t(-1)) {
+				continue;
+			}
+			while(parent[a] != a) {
+				a = parent[a];
+			}
+			while(parent[b] != b) {
+				b = parent[b];
+			}
+			parent[std::max(a, b)] = std::min(a, b);
+		}
+	}
+	
+	std::vector<chunk_group> groups;
+	std::vector<size_t> group_of_root(parent.size(), size_t(-1));
+	size_t i = 0;
+	for(Chunks::const_iterator chunk = chunks.begin(); chunk != chunks.end(); ++chunk, ++i) {
+		size_t root = i;
+		while(parent[root] != root) {
+			root = parent[root];
+		}
+		if(group_of_root[root] == size_t(-1)) {
+			group_of_root[root] = groups.size();
+			groups.push_back(chunk_group());
+		}
+		chunk_group & group = groups[group_of_root[root]];
+		group.chunks.push_back(chunk);
+		group.size += chunk->first.size;
+	}
+	
+	std::stable_sort(groups.begin(), groups.end());
+	
+	return groups;
+}
+
+//! Find the device storing most of the data for each group of chunks.
+void find_group_devices(std::vector<chunk_group> & groups, const stream::slice_reader & slice_reader) {
+	
+	typedef std::map<boost::uint64_t, boost::uint64_t> DeviceSizes;
+	
+	std::map<size_t, boost::uint64_t> slice_devices;
+	std::set<boost::uint64_t> devices;
+	
+	BOOST_FOREACH(chunk_group & group, groups) {
+		
+		DeviceSizes sizes;
+		BOOST_FOREACH(Chunks::const_iterator chunk, group.chunks) {
+			const stream::chunk & info = chunk->first;
+			size_t slices = size_t(info.last_slice) - size_t(info.first_slice) + 1;
+			for(size_t slice = info.first_slice; slice <= info.last_slice; slice++) {
+				std::map<size_t, boost::uint64_t>::iterator device = slice_devices.find(slice);
+				if(device == slice_devices.end()) {
+					boost::uint64_t id = util::device_id(slice_reader.find_slice(slice));
+					device = slice_devices.insert(std::make_pair(slice, id)).first;
+				}
+				sizes[device->second] += info.size / slices + 1;
+			}
+		}
+		
+		boost::uint64_t largest = 0;
+		BOOST_FOREACH(const DeviceSizes::value_type & device, sizes) {
+			if(device.second > largest) {
+				group.device = device.first;
+				largest = device.second;
+			}
+		}
+		devices.insert(group.device);
+		
+	}
+	
+	debug("[chunk groups are stored on " << devices.size() << " devices]");
+}
+
+/*!
+ * Process groups of chunks on multiple threads.
+ *
+ * Each thread has its own \ref stream::slice_reader and \ref chunk_extractor and takes the
+ * next unprocessed group whenever it is done with the previous one.
+ *
+ * Groups are preferably taken from the device with the fewest groups in progress so that
+ * slices stored on different disks are read at the same time instead of one after another.
+ */
+class parallel_extractor : public util::runnable {
+	
+	const fs::path & installer;
+	const extract_options & o;
+	const setup::info & info;
+	const loader::offsets & offsets;
+	const stream::slice_manifest * slices;
+	const std::string & key;
+	const LocationOutputs & files_for_location;
+	progress & extract_progress;
+	stream::seek_index * index;
+	extract_journal * journal;
+	const content_store * store;
+	
+	const std::vector<chunk_group> & groups;
+	
+	output_capture * capture; //!< Output capture of the thread that started the extraction.
+	
+	util::mutex mutex;
+	size_t next_group; //!< First group that has not been started.
+	std::vector<bool> started;
+	std::map<boost::uint64_t, size_t> active; //!< Number of groups in progress for each device.
+	bool incomplete;
+	
+	//! \return the next group to process after the given one is done.
+	const chunk_group * next(const chunk_group * done) {
+		
+		util::scoped_lock<util::mutex> lock(mutex);
+		
+		if(done) {
+			active[done->device]--;
+		}
+		
+		// Take the largest group from the least busy device
+		size_t best = groups.size();
+		size_t best_active = size_t(-1);
+		for(size_t i = next_group; i < groups.size() && best_active != 0; i++) {
+			if(!started[i] && active[groups[i].device] < best_active) {
+				best = i;
+				best_active = active[groups[i].device];
+			}
+		}
+		if(best == groups.size()) {
+			return NULL;
+		}
+		
+		started[best] = true;
+		active[groups[best].device]++;
+		while(next_group < groups.size() && started[next_group]) {
+			next_group++;
+		}
+		
+		return &groups[best];
+	}
+	
+	//! Don't start any more groups.
+	void abort() {
+		util::scoped_lock<util::mutex> lock(mutex);
+		next_group = groups.size();
+	}
+	
+public:
+	
+	parallel_extractor(const fs::path & installer_path, const extract_options & options,
+	                   const setup::info & setup_info, const loader::offsets & setup_offsets,
+	                   const stream::slice_manifest * slice_files,
+	                   const std::string & password_key, const LocationOutputs & outputs,
+	                   progress & shared_progress, stream::seek_index * seek_index,
+	                   extract_journal * extracted, const content_store * contents,
+	                   const std::vector<chunk_group> & chunk_groups)
+		: installer(installer_path), o(options), info(setup_info), offsets(setup_offsets), slices(slice_files)
+		, key(password_key), files_for_location(outputs), extract_progress(shared_progress)
+		, index(seek_index), journal(extracted), store(contents), groups(chunk_groups), capture(output_capture::current())
+		, next_group(0), started(chunk_groups.size(), false), incomplete(false)
+	{ }
+	
+	void run() {
+		
+		output_capture::scope redirect(capture);
+		
+		chunk_extractor extractor(installer, o, info, offsets, slices, key, files_for_location,
+		                          extract_progress, index, journal, store);
+		
+		try {
+			boost::scoped_ptr<stream::slice_reader> slice_reader;
+			const chunk_group * group = NULL;
+			while((group = next(group)) != NULL) {
+				if(!slice_reader) {
+					slice_reader.reset(open_slice_reader(installer, offsets, info, slices));
+				}
+				BOOST_FOREACH(Chunks::const_iterator chunk, group->chunks) {
+					extractor.process(slice_reader.get(), *chunk);
+				}
+			}
+		} catch(...) {
+			abort();
+			throw;
+		}
+		
+		if(extractor.has_incomplete_files()) {
+			util::scoped_lock<util::mutex> lock(mutex);
+			incomplete = true;
+		}
+		
+	}
+	
+	//! \return true if any multi-part file has not been completely written.
+	bool has_incomplete_files() const { return incomplete; }
+	
+};
+
+//! Compare existing output files with the installer checksums on multiple threads.
+class parallel_verifier : public util::runnable {
+	
+	const extract_options & o;
+	const setup::info & info;
+	const std::vector<const processed_file *> & files;
+	std::vector<file_state> & states;
+	
+	util::mutex mutex;
+	size_t next_file;
+	
+	size_t next() {
+		util::scoped_lock<util::mutex> lock(mutex);
+		return (next_file < files.size()) ? next_file++ : size_t(-1);
+	}
+	
+public:
+	
+	parallel_verifier(const extract_options & options, const setup::info & setup_info,
+	                  const std::vector<const processed_file *> & file_list,
+	                  std::vector<file_state> & file_states)
+		: o(options), info(setup_info), files(file_list), states(file_states), next_file(0)
+	{ }
+	
+	void run() {
+		for(size_t i = next(); i != size_t(-1); i = next()) {
+			states[i] = check_file(o, info, *files[i]);
+		}
+	}
+	
+};
+
+/*!
+ * Compare existing files that have no usable checksum with the decompressed data.
+ *
+ * Files stay in the \c FileUnknown state if their data is encrypted and no password was
+ * provided.
+ */
+void compare_decompressed(const fs::path & installer, const extract_options & o,
+                          const setup::info & info, const loader::offsets & offsets,
+                          const std::string & key, const std::vector<const processed_file *> & files,
+                          std::vector<file_state> & states) {
+	
+	// Parts of unverified files for each data entry: file index and offset in the file
+	typedef std::vector< std::pair<size_t, boost::uint64_t> > Parts;
+	std::vector<Parts> parts(info.data_entries.size());
+	std::vector<size_t> remaining(files.size(), 0);
+	Chunks chunks;
+	for(size_t i = 0; i < files.size(); i++) {
+		if(states[i] != FileUnknown) {
+			continue;
+		}
+		boost::uint64_t offset = 0;
+		BOOST_FOREACH(boost::uint32_t location, file_locations(*files[i])) {
+			const setup::data_entry & data = info.data_entries[location];
+			parts[location].push_back(std::make_pair(i, offset));
+			chunks[data.chunk][data.file] = location;
+			offset += data.uncompressed_size;
+			remaining[i]++;
+		}
+	}
+	
+	if(chunks.empty()) {
+		return;
+	}
+	
+	boost::scoped_ptr<stream::slice_manifest> slices(find_slices(installer, o, offsets, info, chunks, key, true));
+	boost::scoped_ptr<stream::slice_reader> slice_reader(open_slice_reader(installer, offsets, info,
+	                                                                       slices.get()));
+	
+	BOOST_FOREACH(const Chunks::value_type & chunk, chunks) {
+		
+		if(chunk.first.encryption != stream::Plaintext && key.empty()) {
+			continue;
+		}
+		
+		debug("[comparing files with " << chunk.first.compression << " chunk @ slice "
+		      << chunk.first.first_slice << " + " << print_hex(chunk.first.offset) << ']');
+		
+		stream::chunk_reader::pointer chunk_source;
+		chunk_source = stream::chunk_reader::get(*slice_reader, chunk.first, key);
+		boost::uint64_t offset = 0;
+		
+		BOOST_FOREACH(const Files::value_type & location, chunk.second) {
+			const stream::file & file = location.first;
+			
+			if(file.offset < offset) {
+				throw format_error("Bad offset while comparing files");
+			}
+			util::discard(*chunk_source, file.offset - offset);
+			offset = file.offset + file.size;
+			
+			boost::ptr_vector<util::ifstream> targets;
+			BOOST_FOREACH(const Parts::value_type & part, parts[location.second]) {
+				util::ifstream * ifs = new util::ifstream;
+				targets.push_back(ifs);
+				ifs->open(o.output_dir / files[part.first]->path(), std::ios_base::in | std::ios_base::binary);
+				if(!ifs->is_open() || ifs->seekg(std::streamoff(part.second)).fail()) {
+					states[part.first] = FileModified;
+				}
+			}
+			
+			stream::file_reader::pointer file_source = stream::file_reader::get(*chunk_source, file, NULL);
+			char buffer[8192 * 10];
+			char existing[sizeof(buffer)];
+			boost::uint64_t size = 0;
+			while(!file_source->eof()) {
+				file_source->read(buffer, std::streamsize(sizeof(buffer)));
+				size_t n = size_t(file_source->gcount());
+				size += n;
+				for(size_t i = 0; i < targets.size(); i++) {
+					size_t index = parts[location.second][i].first;
+					if(states[index] == FileModified) {
+						continue;
+					}
+					if(targets[i].read(existing, std::streamsize(n)).fail()
+					   || std::memcmp(buffer, existing, n) != 0) {
+						states[index] = FileModified;
+					}
+				}
+			}
+			
+			BOOST_FOREACH(const Parts::value_type & part, parts[location.second]) {
+				if(size != info.data_entries[location.second].uncompressed_size) {
+					states[part.first] = FileModified;
+				} else if(states[part.first] == FileUnknown && --remaining[part.first] == 0) {
+					states[part.first] = FileMatches;
+				}
+			}
+			
+		}
+		
+	}
+	
+}
+
+/*!
+ * Compare the output directory with the files stored in the installer.
+ *
+ * Existing files are hashed and compared with the checksums stored in the installer
+ * headers. Data is only decompressed for files without a usable checksum.
+ * Missing and modified files as well as files in the output directory that are not
+ * part of the installer are reported. Files of the installer that were not selected
+ * by the filters and extraction journals are not reported as extra files.
+ *
+ * \throws std::runtime_error if the output directory does not match the installer.
+ */
+void verify_output_tree(const fs::path & installer, const extract_options & o,
+                        const setup::info & info, const loader::offsets & offsets,
+                        const std::string & key, const FilesMap & processed_files) {
+	
+	std::vector<const processed_file *> files;
+	std::set<fs::path> expected;
+	fs::path root = o.output_dir.empty() ? fs::path(".") : o.output_dir;
+	BOOST_FOREACH(const FilesMap::value_type & i, processed_files) {
+		files.push_back(&i.second);
+		expected.insert(root / i.second.path());
+	}
+	
+	std::vector<file_state> states(files.size(), FileUnknown);
+	parallel_verifier verifier(o, info, files, states);
+	util::run_threads(verifier, std::max(size_t(1), std::min(o.jobs, files.size())));
+	
+	compare_decompressed(installer, o, info, offsets, key, files, states);
+	
+	// Files excluded by the filters may have been extracted by other runs
+	extract_options unfiltered = o;
+	unfiltered.silent = true;
+	unfiltered.extract_temp = true;
+	unfiltered.language_only = false;
+	unfiltered.language.clear();
+	unfiltered.bits = 0;
+	unfiltered.include.clear();
+	unfiltered.select_components = false;
+	unfiltered.select_tasks = false;
+	if(unfiltered.collisions == ErrorOnCollisions) {
+		unfiltered.collisions = OverwriteCollisions;
+	}
+	processed_entries all = filter_variants(unfiltered, info);
+	BOOST_FOREACH(const FilesMap::value_type & i, all.files) {
+		expected.insert(root / i.second.path());
+	}
+	
+	std::vector<std::string> extra;
+	// Report extra files relative to the output directory
+	size_t prefix = (root / "x").string().length() - 1;
+	boost::system::error_code ec;
+	fs::recursive_directory_iterator end;
+	for(fs::recursive_directory_iterator it(root, ec); !ec && it != end; it.increment(ec)) {
+		if(fs::is_directory(it->status()) || expected.find(it->path()) != expected.end()) {
+			continue;
+		}
+		if(it->path().parent_path() == root && extract_journal::is_journal(it->path())) {
+			continue; // Left by an interrupted run for --resume
+		}
+		extra.push_back(it->path().string().substr(prefix));
+	}
+	std::sort(extra.begin(), extra.end());
+	
+	size_t counts[4] = { 0, 0, 0, 0 };
+	for(size_t i = 0; i < files.size(); i++) {
+		counts[states[i]]++;
+		const char * state = NULL;
+		switch(states[i]) {
+			case FileMatches: continue;
+			case FileModified: state = "modified"; break;
+			case FileMissing: state = "missing"; break;
+			case FileUnknown: state = "unverified"; break;
+		}
+		if(o.silent) {
+			std::cout << state << ' ' << files[i]->path() << '\n';
+		} else {
+			std::cout << " - " << '"' << color::white << files[i]->path() << color::reset << '"'
+			          << " - " << (states[i] == FileUnknown ? color::yellow : color::red) << state
+			          << color::reset << '\n';
+		}
+	}
+	BOOST_FOREACH(const std::string & path, extra) {
+		if(o.silent) {
+			std::cout << "extra " << path << '\n';
+		} else {
+			std::cout << " - " << '"' << color::white << path << color::reset << '"'
+			          << " - " << color::red << "extra" << color::reset << '\n';
+		}
+	}
+	
+	if(!o.silent) {
+		std::cout << color::green << counts[FileMatches] << color::reset << " of " << files.size()
+		          << " files match";
+		if(counts[FileModified] != 0) {
+			std::cout << ", " << color::red << counts[FileModified] << color::reset << " modified";
+		}
+		if(counts[FileMissing] != 0) {
+			std::cout << ", " << color::red << counts[FileMissing] << color::reset << " missing";
+		}
+		if(counts[FileUnknown] != 0) {
+			std::cout << ", " << color::yellow << counts[FileUnknown] << color::reset << " unverified";
+		}
+		if(!extra.empty()) {
+			std::cout << ", " << color::red << extra.size() << color::reset << " extra";
+		}
+		std::cout << '\n';
+	}
+	
+	if(counts[FileModified] != 0 || counts[FileMissing] != 0 || !extra.empty()) {
+		throw std::runtime_error("Output directory does not match the installer!");
+	}
+	
+}
+
+} // anonymous namespace
+
+void process_file(const fs::path & installer, const extract_options & o) {
+	
+	bool is_directory;
+	try {
+		is_directory = fs::is_directory(installer);
+	} catch(...) {
+		throw std::runtime_error("Could not open file \"" + installer.string()
+		                         + "\": access denied");
+	}
+	if(is_directory) {
+		throw std::runtime_error("Input file \"" + installer.string() + "\" is a directory!");
+	}
+	
+	util::ifstream ifs;
+	try {
+		ifs.open(installer, std::ios_base::in | std::ios_base::binary);
+		if(!ifs.is_open()) {
+			throw std::exception();
+		}
+	} catch(...) {
+		throw std::runtime_error("Could not open file \"" + installer.string() + '"');
+	}
+	
+	loader::offsets offsets;
+	offsets.load(ifs);
+	
+	#ifdef DEBUG
+	if(logger::debug) {
+		print_offsets(offsets);
+		std::cout << '\n';
+	}
+	#endif
+	
+	if(o.data_version)  {
+		setup::version version;
+		ifs.seekg(offsets.header_offset);
+		version.load(ifs);
+		if(o.silent) {
+			std::cout << version << '\n';
+		} else {
+			std::cout << color::white << version << color::reset << '\n';
+		}
+		return;
+	}
+	
+	#ifdef DEBUG
+	if(o.dump_headers)  {
+		create_output_directory(o);
+		dump_headers(ifs, offsets, o);
+		return;
+	}
+	#endif
+	
+	setup::info::entry_types entries = 0;
+	if(o.list || o.test || o.extract || o.verify_tree || o.plan || (o.gog_galaxy && o.list_languages)) {
+		entries |= setup::info::Files;
+		entries |= setup::info::Directories;
+		entries |= setup::info::DataEntries;
+	}
+	if(o.list_languages || o.variants == LanguageVariants) {
+		entries |= setup::info::Languages;
+	}
+	if(o.select_components || o.select_tasks) {
+		entries |= setup::info::Components | setup::info::Tasks | setup::info::Types;
+	}
+	if(o.gog_game_id || o.gog) {
+		entries |= setup::info::RegistryEntries;
+	}
+	if(!o.extract_unknown) {
+		entries |= setup::info::NoUnknownVersion;
+	}
+#ifdef DEBUG
+	if(logger::debug) {
+		entries = setup::info::entry_types::all();
+	}
+#endif
+	
+	ifs.seekg(offsets.header_offset);
+	setup::info info;
+	try {
+		if(o.header_cache.empty()) {
+			info.load(ifs, entries, o.codepage);
+		} else {
+			setup::header_cache cache(o.header_cache, installer, ifs, offsets.header_offset);
+			if(!cache.load(info, entries, o.codepage)) {
+				setup::info::header_blocks blocks;
+				info.load(ifs, entries, o.codepage, &blocks);
+				cache.store(info.version, blocks);
+			}
+		}
+	} catch(const setup::version_error &) {
+		fs::path headerfile = installer;
+		headerfile.replace_extension(".0");
+		if(offsets.header_offset == 0 && headerfile != installer && fs::exists(headerfile)) {
+			log_info << "Opening \"" << color::cyan << headerfile.string() << color::reset << '"';
+			process_file(headerfile, o);
+			return;
 		}
 		if(offsets.found_magic) {
 			if(offsets.header_offset == 0) {
@@ -1013,7 +3701,7 @@ void process_file(const fs::path & installer, const extract_options & o) {
 		throw format_error(oss.str());
 	}
 	
-	if(o.gog_galaxy && (o.list || o.test || o.extract || o.list_languages)) {
+	if(o.gog_galaxy && (o.list || o.test || o.extract || o.verify_tree || o.plan || o.list_languages)) {
 		gog::parse_galaxy_files(info, o.gog);
 	}
 	
@@ -1021,7 +3709,8 @@ void process_file(const fs::path & installer, const extract_options & o) {
 	
 	std::string key;
 	if(o.password.empty()) {
-		if(!o.quiet && (o.list || o.test || o.extract) && (info.header.options & setup::header::EncryptionUsed)) {
+		if(!o.quiet && (o.list || o.test || o.extract || o.verify_tree || o.plan)
+		   && (info.header.options & setup::header::EncryptionUsed)) {
 			log_warning << "Setup contains encrypted files, use the --password option to extract them";
 		}
 	} else {
@@ -1041,7 +3730,7 @@ void process_file(const fs::path & installer, const extract_options & o) {
 		#endif
 	}
 	
-	if(!o.list && !o.test && !o.extract) {
+	if(!o.list && !o.test && !o.extract && !o.verify_tree && !o.plan) {
 		return;
 	}
 	
@@ -1049,10 +3738,54 @@ void process_file(const fs::path & installer, const extract_options & o) {
 		std::cout << "Files:\n";
 	}
 	
-	processed_entries processed = filter_entries(o, info);
+	processed_entries processed = filter_variants(o, info);
+	
+	if(o.verify_tree) {
+		verify_output_tree(installer, o, info, offsets, key, processed.files);
+		return;
+	}
+	
+	// Keep the full list for --delta-from so that files from other shards aren't reported as deleted
+	file_manifest selected;
+	if(!o.delta_from.empty()) {
+		add_to_manifest(selected, info, processed.files);
+	}
+	
+	if(o.shards > 1) {
+		size_t total = processed.files.size();
+		select_shard(o, info, processed.files);
+		if(!o.manifest.empty()) {
+			file_manifest manifest;
+			std::string identity = installer.filename().string() + ':' + installer_identity(installer, offsets);
+			manifest.set_shard(o.shard, o.shards, total, identity);
+			add_to_manifest(manifest, info, processed.files);
+			manifest.save(o.manifest);
+		}
+	} else if(!o.manifest.empty()) {
+		file_manifest manifest;
+		add_to_manifest(manifest, info, processed.files);
+		manifest.save(o.manifest);
+	}
+	
+	if(o.sink && o.sink->single_file() && processed.files.size() != 1) {
+		std::ostringstream oss;
+		oss << "Need exactly one file to write to standard output, but " << processed.files.size()
+		    << " files are selected - use --include to select one";
+		throw std::runtime_error(oss.str());
+	}
 	
-	if(o.extract) {
+	boost::scoped_ptr<extract_journal> journal;
+	boost::scoped_ptr<content_store> store;
+	if(o.extract && !o.sink) {
 		create_output_directory(o);
+		if(!o.test && !o.store.empty()) {
+			store.reset(new content_store(o.store));
+		}
+		check_free_space(o, info, processed.files, store.get());
+		if(o.resume && !o.test) {
+			std::string identity = installer.filename().string() + ':' + installer_identity(installer, offsets);
+			journal.reset(new extract_journal(o.output_dir, identity));
+		}
 	}
 	
 	if(o.list || o.extract) {
@@ -1078,7 +3811,9 @@ void process_file(const fs::path & installer, const extract_options & o) {
 				
 			}
 			
-			if(o.extract) {
+			if(o.extract && o.sink) {
+				o.sink->add_directory(path, util::time(std::time(NULL)));
+			} else if(o.extract) {
 				fs::path dir = o.output_dir / path;
 				try {
 					fs::create_directory(dir);
@@ -1091,8 +3826,7 @@ void process_file(const fs::path & installer, const extract_options & o) {
 		
 	}
 	
-	typedef std::pair<const processed_file *, boost::uint64_t> output_location;
-	std::vector< std::vector<output_location> > files_for_location;
+	LocationOutputs files_for_location;
 	files_for_location.resize(info.data_entries.size());
 	BOOST_FOREACH(const FilesMap::value_type & i, processed.files) {
 		const processed_file & file = i.second;
@@ -1119,10 +3853,37 @@ void process_file(const fs::path & installer, const extract_options & o) {
 		}
 	}
 	
+	std::set<const processed_file *> done;
+	
+	std::vector<std::string> deleted;
+	if(!o.delta_from.empty()) {
+		file_manifest previous;
+		load_previous_manifest(o.delta_from, o, previous);
+		skip_unchanged_files(previous, selected, processed.files, done, deleted);
+		if(o.shard != 0) {
+			deleted.clear(); // Only report deleted files once for all shards
+		}
+	}
+	
+	if(o.extract && !o.test && !o.sink) {
+		if(o.existing != OverwriteExisting) {
+			skip_existing_files(o, info, processed.files, done);
+		}
+		if(store) {
+			link_stored_files(o, info, *store, processed.files, done);
+		}
+	}
+	
+	if(!o.delta_from.empty() || (o.extract && !o.test && !o.sink)) {
+		remove_outputs(files_for_location, done);
+	}
+	
+	if((o.extract && !o.test && !o.sink) || o.plan) {
+		merge_duplicate_data(info, key, files_for_location);
+	}
+	
 	boost::uint64_t total_size = 0;
 	
-	typedef std::map<stream::file, size_t> Files;
-	typedef std::map<stream::chunk, Files> Chunks;
 	Chunks chunks;
 	for(size_t i = 0; i < info.data_entries.size(); i++) {
 		if(!files_for_location[i].empty()) {
@@ -1132,287 +3893,72 @@ void process_file(const fs::path & installer, const extract_options & o) {
 		}
 	}
 	
-	boost::scoped_ptr<stream::slice_reader> slice_reader;
-	if(o.extract || o.test) {
-		if(offsets.data_offset) {
-			slice_reader.reset(new stream::slice_reader(&ifs, offsets.data_offset));
-		} else {
-			fs::path dir = installer.parent_path();
-			std::string basename = util::as_string(installer.stem());
-			std::string basename2 = info.header.base_filename;
-			// Prevent access to unexpected files
-			std::replace(basename2.begin(), basename2.end(), '/', '_');
-			std::replace(basename2.begin(), basename2.end(), '\\', '_');
-			// Older Inno Setup versions used the basename stored in the headers, change our default accordingly
-			if(info.version < INNO_VERSION(4, 1, 7) && !basename2.empty()) {
-				std::swap(basename2, basename);
-			}
-			slice_reader.reset(new stream::slice_reader(dir, basename, basename2, info.header.slices_per_disk));
-		}
+	boost::scoped_ptr<stream::slice_manifest> slices;
+	if(o.extract || o.test || o.plan) {
+		// Fail before decompressing anything if slices are missing
+		slices.reset(find_slices(installer, o, offsets, info, chunks, key, !o.plan));
+	}
+	
+	if(o.plan) {
+		print_plan(std::cout, installer, offsets, info, slices.get(), chunks, files_for_location);
+		return;
 	}
 	
 	progress extract_progress(total_size);
 	
-	typedef boost::ptr_map<const processed_file *, file_output> multi_part_outputs;
-	multi_part_outputs multi_outputs;
+	boost::scoped_ptr<stream::seek_index> index;
+	if((o.extract || o.test) && !o.seek_index.empty()) {
+		index.reset(new stream::seek_index(o.seek_index, installer_identity(installer, offsets, slices.get())));
+	}
 	
-	BOOST_FOREACH(const Chunks::value_type & chunk, chunks) {
+	bool incomplete;
+	if((o.extract || o.test) && o.jobs > 1 && chunks.size() > 1 && !o.sink) {
 		
-		debug("[starting " << chunk.first.compression << " chunk @ slice " << chunk.first.first_slice
-		      << " + " << print_hex(offsets.data_offset) << " + " << print_hex(chunk.first.offset)
-		      << ']');
-		
-		stream::chunk_reader::pointer chunk_source;
-		if((o.extract || o.test) && (chunk.first.encryption == stream::Plaintext || !key.empty())) {
-			chunk_source = stream::chunk_reader::get(*slice_reader, chunk.first, key);
+		std::vector<chunk_group> groups = group_chunks(chunks, info, processed.files);
+		if(!offsets.data_offset) {
+			boost::scoped_ptr<stream::slice_reader> slice_reader(open_slice_reader(installer, offsets, info,
+			                                                                       slices.get()));
+			find_group_devices(groups, *slice_reader);
 		}
-		boost::uint64_t offset = 0;
+		size_t threads = std::min(o.jobs, groups.size());
+		debug("[processing " << groups.size() << " chunk groups on " << threads << " threads]");
 		
-		BOOST_FOREACH(const Files::value_type & location, chunk.second) {
-			const stream::file & file = location.first;
-			const std::vector<output_location> & output_locations = files_for_location[location.second];
-			
-			if(file.offset > offset) {
-				debug("discarding " << print_bytes(file.offset - offset)
-				      << " @ " << print_hex(offset));
-				if(chunk_source.get()) {
-					util::discard(*chunk_source, file.offset - offset);
-				}
-			}
-			
-			// Print filename and size
-			if(o.list) {
-				
-				extract_progress.clear(DeferredClear);
-				
-				if(!o.silent) {
-					
-					bool named = false;
-					boost::uint64_t size = 0;
-					const crypto::checksum * checksum = NULL;
-					BOOST_FOREACH(const output_location & output, output_locations) {
-						if(output.second != 0) {
-							continue;
-						}
-						bool mismatch = false;
-						if(output.first->entry().size != 0) {
-							if(size != 0 && size != output.first->entry().size) {
-								mismatch = true;
-							}
-							size = output.first->entry().size;
-						}
-						if(output.first->entry().checksum.type != crypto::None) {
-							if(checksum && *checksum != output.first->entry().checksum) {
-								mismatch = true;
-							}
-							checksum = &output.first->entry().checksum;
-						}
-						if(mismatch) {
-							// Different file even though the starting location is the same
-							if(named) {
-								print_file_details(o, file, chunk.first, size, checksum, key);
-								named = false;
-							}
-						}
-						if(named) {
-							std::cout << ", ";
-						} else {
-							std::cout << " - ";
-							named = true;
-						}
-						if(chunk.first.encryption != stream::Plaintext) {
-							if(key.empty()) {
-								std::cout << '"' << color::dim_yellow << output.first->path() << color::reset << '"';
-							} else {
-								std::cout << '"' << color::yellow << output.first->path() << color::reset << '"';
-							}
-						} else {
-							std::cout << '"' << color::white << output.first->path() << color::reset << '"';
-						}
-						print_filter_info(output.first->entry());
-					}
-					
-					if(named) {
-						print_file_details(o, file, chunk.first, size, checksum, key);
-					}
-					
-				} else {
-					BOOST_FOREACH(const output_location & output, output_locations) {
-						if(output.second == 0) {
-							const processed_file * fileinfo = output.first;
-							if(o.list_sizes) {
-								boost::uint64_t size = fileinfo->entry().size;
-								std::cout << color::dim_cyan << (size != 0 ? size : file.size) << color::reset << ' ';
-							}
-							if(o.list_checksums) {
-								print_checksum_info(file, &fileinfo->entry().checksum);
-								std::cout << ' ';
-							}
-							std::cout << color::white << fileinfo->path() << color::reset << '\n';
-						}
-					}
-				}
-				
-				bool updated = extract_progress.update(0, true);
-				if(!updated && (o.extract || o.test)) {
-					std::cout.flush();
-				}
-				
-			}
-			
-			// Seek to the correct position within the chunk
-			if(chunk_source.get() && file.offset < offset) {
-				std::ostringstream oss;
-				oss << "Bad offset while extracting files: file start (" << file.offset
-				    << ") is before end of previous file (" << offset << ")!";
-				throw format_error(oss.str());
-			}
-			offset = file.offset + file.size;
-			
-			if(!chunk_source.get()) {
-				continue; // Not extracting/testing this file
-			}
-			
-			crypto::checksum checksum;
-			
-			// Open input file
-			stream::file_reader::pointer file_source;
-			file_source = stream::file_reader::get(*chunk_source, file, &checksum);
-			
-			// Open output files
-			boost::ptr_vector<file_output> single_outputs;
-			typedef std::pair<file_output *, boost::uint64_t> file_output_location;
-			std::vector<file_output_location> outputs;
-			BOOST_FOREACH(const output_location & output_loc, output_locations) {
-				const processed_file * fileinfo = output_loc.first;
-				try {
-					
-					if(!o.extract && fileinfo->entry().checksum.type == crypto::None) {
-						continue;
-					}
-					
-					// Re-use existing file output for multi-part files
-					file_output * output = NULL;
-					if(fileinfo->is_multipart()) {
-						multi_part_outputs::iterator it = multi_outputs.find(fileinfo);
-						if(it != multi_outputs.end()) {
-							output = it->second;
-						}
-					}
-					
-					if(!output) {
-						output = new file_output(o.output_dir, fileinfo, o.extract);
-						if(fileinfo->is_multipart()) {
-							multi_outputs.insert(fileinfo, output);
-						} else {
-							single_outputs.push_back(output);
-						}
-					}
-					
-					outputs.push_back(file_output_location(output, output_loc.second));
-					
-				} catch(boost::bad_pointer &) {
-					// should never happen
-					std::terminate();
-				}
-			}
-			
-			// Copy data
-			boost::uint64_t output_size = 0;
-			while(!file_source->eof()) {
-				char buffer[8192 * 10];
-				std::streamsize buffer_size = std::streamsize(boost::size(buffer));
-				std::streamsize n = file_source->read(buffer, buffer_size).gcount();
-				if(n > 0) {
-					BOOST_FOREACH(file_output_location & out, outputs) {
-						file_output * output = out.first;
-						output->seek(out.second + output_size);
-						bool success = output->write(buffer, size_t(n));
-						if(!success) {
-							throw std::runtime_error("Error writing file \"" + output->path().string() + '"');
-						}
-					}
-					extract_progress.update(boost::uint64_t(n));
-					output_size += boost::uint64_t(n);
-				}
-			}
-			
-			const setup::data_entry & data = info.data_entries[location.second];
-			
-			if(output_size != data.uncompressed_size) {
-				log_warning << "Unexpected output file size: " << output_size << " != " << data.uncompressed_size;
-			}
-			
-			util::time filetime = data.timestamp;
-			if(o.extract && o.preserve_file_times && o.local_timestamps && !(data.options & data.TimeStampInUTC)) {
-				filetime = util::to_local_time(filetime);
-			}
-			
-			BOOST_FOREACH(file_output_location & out, outputs) {
-				file_output * output = out.first;
-				
-				if(!output || (output->file()->is_multipart() && !output->is_complete())) {
-					continue;
-				}
-				
-				// Verify output checksum if available
-				if(output->file()->entry().checksum.type != crypto::None && output->calculate_checksum()) {
-					crypto::checksum output_checksum = output->checksum();
-					if(output_checksum != output->file()->entry().checksum) {
-						log_warning << "Output checksum mismatch for " << output->file()->path() << ":\n"
-						            << " ├─ actual:   " << output_checksum << '\n'
-						            << " └─ expected: " << output->file()->entry().checksum;
-						if(o.test) {
-							throw std::runtime_error("Integrity test failed!");
-						}
-					}
-				}
-				
-				// Adjust file timestamps
-				if(o.extract && o.preserve_file_times) {
-					output->close();
-					if(!util::set_file_time(output->path(), filetime, data.timestamp_nsec)) {
-						log_warning << "Error setting timestamp on file " << output->path();
-					}
-				}
-				
-				BOOST_FOREACH(file_output_location & other, outputs) {
-					if(other.first == output) {
-						other.first = NULL;
-					}
-				}
-				
-				if(output->file()->is_multipart()) {
-					debug("[finalizing multi-part file]");
-					multi_outputs.erase(output->file());
-				}
-				
-			}
-			
-			// Verify checksums
-			if(checksum != file.checksum) {
-				log_warning << "Checksum mismatch:\n"
-				            << " ├─ actual:   " << checksum << '\n'
-				            << " └─ expected: " << file.checksum;
-				if(o.test) {
-					throw std::runtime_error("Integrity test failed!");
-				}
-			}
-			
+		parallel_extractor extractor(installer, o, info, offsets, slices.get(), key, files_for_location,
+		                             extract_progress, index.get(), journal.get(), store.get(), groups);
+		util::run_threads(extractor, threads);
+		incomplete = extractor.has_incomplete_files();
+		
+	} else {
+		
+		boost::scoped_ptr<stream::slice_reader> slice_reader;
+		if(o.extract || o.test) {
+			slice_reader.reset(open_slice_reader(installer, offsets, info, slices.get()));
 		}
 		
-		#ifdef DEBUG
-		if(offset < chunk.first.size) {
-			debug("discarding " << print_bytes(chunk.first.size - offset)
-			      << " at end of chunk @ " << print_hex(offset));
+		chunk_extractor extractor(installer, o, info, offsets, slices.get(), key, files_for_location,
+		                          extract_progress, index.get(), journal.get(), store.get());
+		BOOST_FOREACH(const Chunks::value_type & chunk, chunks) {
+			extractor.process(slice_reader.get(), chunk);
 		}
-		#endif
+		incomplete = extractor.has_incomplete_files();
+		
 	}
 	
 	extract_progress.clear();
 	
-	if(!multi_outputs.empty()) {
+	if(incomplete) {
 		log_warning << "Incomplete multi-part files";
+	} else if(journal) {
+		journal->remove();
+	}
+	
+	BOOST_FOREACH(const std::string & path, deleted) {
+		if(o.silent) {
+			std::cout << "deleted " << path << '\n';
+		} else {
+			std::cout << " - " << '"' << color::dim_white << path << color::reset << '"'
+			          << " - " << color::red << "deleted" << color::reset << '\n';
+		}
 	}
 	
 	if(o.warn_unused || o.gog) {
@@ -35,6 +35,8 @@
 
 #include "setup/filename.hpp"
 
+class output_sink;
+
 struct format_error : public std::runtime_error {
 	explicit format_error(const std::string & reason) : std::runtime_error(reason) { }
 };
@@ -46,6 +48,28 @@ enum CollisionAction {
 	ErrorOnCollisions
 };
 
+//! How to create multiple files with the same contents.
+enum DuplicateAction {
+	WriteDuplicates,   //!< Write the data to each file
+	CopyDuplicates,    //!< Write the data once and copy the file
+	ReflinkDuplicates, //!< Write the data once and share it between files if possible
+	HardlinkDuplicates //!< Write the data once and create hard links
+};
+
+//! Separate output trees to extract in a single pass.
+enum VariantType {
+	NoVariants,          //!< Extract a single tree
+	LanguageVariants,    //!< Extract one tree for each language
+	ArchitectureVariants //!< Extract one tree each for 32-bit and 64-bit installs
+};
+
+//! Which existing output files to keep instead of extracting them again.
+enum ExistingAction {
+	OverwriteExisting,     //!< Always extract files
+	SkipExistingByTime,    //!< Keep files with the expected size and modification time
+	SkipExistingByChecksum //!< Keep files with the expected size and checksum
+};
+
 struct extract_options {
 	
 	bool quiet;
@@ -63,6 +87,8 @@ struct extract_options {
 	bool list; //!< List files
 	bool test; //!< Test files (but don't extract)
 	bool extract; //!< Extract files
+	bool verify_tree; //!< Compare the output directory with the installer
+	bool plan; //!< Print the amount of data that needs to be decompressed
 	bool list_languages; //!< List available languages
 	bool gog_game_id; //!< Show the GOG.com game id
 	bool show_password; //!< Show password check information
@@ -79,17 +105,40 @@ struct extract_options {
 	bool extract_temp; //!< Extract temporary files
 	bool language_only; //!< Extract files not associated with any language
 	std::string language; //!< Extract only files for this language
+	size_t bits; //!< Extract only files for 32-bit or 64-bit installs, or 0 for all files
 	std::vector<std::string> include; //!< Extract only files matching these patterns
+	std::string setup_type; //!< Select the components of this setup type
+	std::vector<std::string> components; //!< Components to select or, with a ! prefix, deselect
+	std::vector<std::string> tasks; //!< Tasks to select or, with a ! prefix, deselect
+	bool select_components; //!< Extract only files for the selected components
+	bool select_tasks; //!< Extract only files for the selected tasks
+	VariantType variants; //!< Extract separate trees for each variant of the files
 	
 	boost::uint32_t codepage;
 	
 	setup::filename_map filenames;
 	CollisionAction collisions;
 	std::string default_language;
+	DuplicateAction duplicates; //!< How to create files with the same contents
+	ExistingAction existing; //!< Which existing files to keep
 	
 	std::string password;
 	
 	boost::filesystem::path output_dir;
+	output_sink * sink; //!< Stream extracted files to this sink instead of output_dir
+	
+	size_t jobs; //!< Number of threads to use for extracting/testing files
+	bool resume; //!< Skip files recorded as extracted in the journal of a previous run
+	bool drop_cache; //!< Keep installer and output data from accumulating in the page cache
+	
+	boost::filesystem::path seek_index; //!< Load and store decompression checkpoints in this file
+	boost::filesystem::path header_cache; //!< Directory for cached setup headers
+	boost::filesystem::path store; //!< Content-addressed store to link output files to
+	boost::filesystem::path delta_from; //!< Only extract files changed since this installer or manifest
+	boost::filesystem::path manifest; //!< Write a manifest of the selected files to this file
+	
+	size_t shard; //!< Zero-based index of the shard of the chunks to process
+	size_t shards; //!< Number of shards to split the chunks into or 0 to process all chunks
 	
 	extract_options()
 		: quiet(false)
@@ -101,6 +150,8 @@ struct extract_options {
 		, list(false)
 		, test(false)
 		, extract(false)
+		, verify_tree(false)
+		, plan(false)
 		, list_languages(false)
 		, gog_game_id(false)
 		, show_password(false)
@@ -112,7 +163,19 @@ struct extract_options {
 		, extract_unknown(false)
 		, extract_temp(false)
 		, language_only(false)
+		, bits(0)
+		, select_components(false)
+		, select_tasks(false)
+		, variants(NoVariants)
 		, collisions(OverwriteCollisions)
+		, duplicates(WriteDuplicates)
+		, existing(OverwriteExisting)
+		, sink(NULL)
+		, jobs(1)
+		, resume(false)
+		, drop_cache(false)
+		, shard(0)
+		, shards(0)
 	{ }
 	
 };
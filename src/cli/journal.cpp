@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "cli/journal.hpp"
+
+#include <sstream>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/range/size.hpp>
+
+#include "crypto/hasher.hpp"
+#include "util/log.hpp"
+#include "util/output.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+const char journal_magic[] = "innoextract journal 1";
+
+const char journal_prefix[] = ".innoextract-";
+const char journal_suffix[] = ".journal";
+
+//! \return a string representation of a checksum that does not contain any spaces.
+std::string checksum_string(const crypto::checksum & checksum) {
+	
+	std::ostringstream oss;
+	oss << int(checksum.type) << ':';
+	
+	switch(checksum.type) {
+		case crypto::None: break;
+		case crypto::Adler32: oss << std::hex << checksum.adler32; break;
+		case crypto::CRC32: oss << std::hex << checksum.crc32; break;
+		case crypto::MD5: oss << print_hex(checksum.md5, size_t(boost::size(checksum.md5))); break;
+		case crypto::SHA1: oss << print_hex(checksum.sha1, size_t(boost::size(checksum.sha1))); break;
+		case crypto::SHA256: oss << print_hex(checksum.sha256, size_t(boost::size(checksum.sha256))); break;
+		default: oss << print_hex(checksum.check, size_t(boost::size(checksum.check))); break;
+	}
+	
+	return oss.str();
+}
+
+} // anonymous namespace
+
+extract_journal::extract_journal(const fs::path & output_dir, const std::string & identity)
+	: dir(output_dir), writable(true) {
+	
+	crypto::hasher hash(crypto::SHA1);
+	hash.update(identity.data(), identity.size());
+	crypto::checksum name = hash.finalize();
+	std::ostringstream filename;
+	filename << journal_prefix << print_hex(name.sha1, 8) << journal_suffix;
+	path = dir / filename.str();
+	
+	boost::uint64_t end = 0;
+	if(fs::exists(path)) {
+		end = load(identity);
+	}
+	
+	if(end == 0) {
+		files.clear();
+		ofs.open(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		ofs << journal_magic << '\n' << identity << '\n';
+		ofs.flush();
+	} else {
+		if(fs::file_size(path) != end) {
+			// Drop an incompletely written entry
+			fs::resize_file(path, end);
+		}
+		ofs.open(path, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+		log_info << "Resuming extraction: " << files.size() << " files already extracted";
+	}
+	
+	if(!ofs.is_open() || ofs.fail()) {
+		log_warning << "Could not write extraction journal \"" << path.string() << '"';
+		writable = false;
+	}
+	
+}
+
+boost::uint64_t extract_journal::load(const std::string & identity) {
+	
+	util::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+	
+	std::string line;
+	if(!std::getline(ifs, line) || line != journal_magic) {
+		log_warning << "Ignoring invalid extraction journal \"" << path.string() << '"';
+		return 0;
+	}
+	boost::uint64_t end = line.length() + 1;
+	
+	if(!std::getline(ifs, line) || ifs.eof() || line != identity) {
+		log_info << "Discarding extraction journal for a different installer";
+		return 0;
+	}
+	end += line.length() + 1;
+	
+	while(std::getline(ifs, line) && !ifs.eof()) {
+		
+		std::istringstream iss(line);
+		entry file;
+		std::string name;
+		if(!(iss >> file.size >> file.checksum) || iss.get() != ' ' || !std::getline(iss, name)) {
+			break;
+		}
+		
+		files[name] = file;
+		end += line.length() + 1;
+	}
+	
+	return end;
+}
+
+bool extract_journal::is_complete(const std::string & file, boost::uint64_t size,
+                                  const crypto::checksum & checksum) const {
+	
+	{
+		util::scoped_lock<util::mutex> lock(mutex);
+		std::map<std::string, entry>::const_iterator i = files.find(file);
+		if(i == files.end() || i->second.size != size || i->second.checksum != checksum_string(checksum)) {
+			return false;
+		}
+	}
+	
+	boost::system::error_code ec;
+	boost::uint64_t existing = fs::file_size(dir / file, ec);
+	
+	return !ec && existing == size;
+}
+
+void extract_journal::record(const std::string & file, boost::uint64_t size,
+                             const crypto::checksum & checksum) {
+	
+	entry result = { size, checksum_string(checksum) };
+	
+	util::scoped_lock<util::mutex> lock(mutex);
+	
+	files[file] = result;
+	
+	if(!writable) {
+		return;
+	}
+	
+	ofs << result.size << ' ' << result.checksum << ' ' << file << '\n';
+	ofs.flush();
+	
+	if(ofs.fail()) {
+		log_warning << "Could not write extraction journal \"" << path.string() << '"';
+		writable = false;
+	}
+	
+}
+
+bool extract_journal::is_journal(const fs::path & file) {
+	std::string name = file.filename().string();
+	return boost::algorithm::starts_with(name, journal_prefix)
+	       && boost::algorithm::ends_with(name, journal_suffix);
+}
+
+void extract_journal::remove() {
+	
+	util::scoped_lock<util::mutex> lock(mutex);
+	
+	ofs.close();
+	writable = false;
+	
+	boost::system::error_code ec;
+	fs::remove(path, ec);
+	if(ec) {
+		log_warning << "Could not remove extraction journal \"" << path.string() << '"';
+	}
+	
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Journal of completely extracted files used to resume interrupted extractions.
+ */
+#ifndef INNOEXTRACT_CLI_JOURNAL_HPP
+#define INNOEXTRACT_CLI_JOURNAL_HPP
+
+#include <map>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "crypto/checksum.hpp"
+#include "util/fstream.hpp"
+#include "util/thread.hpp"
+
+/*!
+ * Record of output files that have been completely written and verified.
+ *
+ * The journal is stored in the output directory, with one journal per installer, until
+ * the extraction has completed.
+ * Each entry stores the path, the size and the expected checksum of a file. New entries
+ * are appended and flushed as soon as they are recorded so that an interrupted run leaves
+ * a usable journal.
+ *
+ * All member functions may be called concurrently.
+ */
+class extract_journal : private boost::noncopyable {
+	
+	struct entry {
+		
+		boost::uint64_t size;
+		std::string checksum;
+		
+	};
+	
+	boost::filesystem::path dir;
+	boost::filesystem::path path;
+	
+	std::map<std::string, entry> files;
+	
+	util::ofstream ofs;
+	bool writable;
+	
+	mutable util::mutex mutex;
+	
+	//! \return the end of the last complete entry.
+	boost::uint64_t load(const std::string & identity);
+	
+public:
+	
+	/*!
+	 * Open or create the journal for an installer.
+	 *
+	 * \param output_dir The directory files are extracted to.
+	 * \param identity   String identifying the installer. Existing journals for a different
+	 *                   identity are discarded.
+	 */
+	extract_journal(const boost::filesystem::path & output_dir, const std::string & identity);
+	
+	/*!
+	 * Check if a file has been completely extracted by a previous run.
+	 *
+	 * \param file     Path of the file relative to the output directory.
+	 * \param size     Expected size of the file.
+	 * \param checksum Checksum identifying the file contents.
+	 *
+	 * \return true if the file was recorded with the same size and checksum and still exists
+	 *         with the expected size.
+	 */
+	bool is_complete(const std::string & file, boost::uint64_t size,
+	                 const crypto::checksum & checksum) const;
+	
+	//! Record that a file has been completely extracted and verified.
+	void record(const std::string & file, boost::uint64_t size, const crypto::checksum & checksum);
+	
+	//! \return true if the file is an extraction journal.
+	static bool is_journal(const boost::filesystem::path & file);
+	
+	/*!
+	 * Delete the journal once all files have been extracted.
+	 *
+	 * The journal is only needed to resume an interrupted run and should not be left
+	 * in the output directory. Later calls to \ref record() are ignored.
+	 */
+	void remove();
+	
+};
+
+#endif // INNOEXTRACT_CLI_JOURNAL_HPP
@@ -18,6 +18,7 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <iomanip>
@@ -25,21 +26,31 @@
 #include <string>
 #include <vector>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
 
 #include "release.hpp"
 
 #include "cli/extract.hpp"
+#include "cli/sink.hpp"
 
 #include "setup/version.hpp"
 
 #include "util/console.hpp"
 #include "util/fstream.hpp"
 #include "util/log.hpp"
+#include "util/thread.hpp"
 #include "util/time.hpp"
 #include "util/windows.hpp"
 
@@ -119,6 +130,241 @@ static void print_license() {
 	;
 }
 
+static void print_bug_report_hint() {
+	std::cerr << color::blue << "If you are sure the setup file is not corrupted,"
+	          << " consider \nfiling a bug report at "
+	          << color::dim_cyan << innoextract_bugs << color::reset << '\n';
+}
+
+/*!
+ * Process one installer and report any errors.
+ *
+ * \param suggest_bug_report Set to \c true if the error could be caused by a bug.
+ *
+ * \return true if the installer was processed without fatal errors.
+ */
+static bool process_installer(const std::string & file, const extract_options & o,
+                              bool & suggest_bug_report) {
+	try {
+		process_file(file, o);
+		return true;
+	} catch(const std::ios_base::failure & e) {
+		log_error << "Stream error while extracting files!\n"
+		          << " └─ error reason: " << e.what();
+		suggest_bug_report = true;
+	} catch(const format_error & e) {
+		log_error << e.what();
+		suggest_bug_report = true;
+	} catch(const std::runtime_error & e) {
+		log_error << e.what();
+	} catch(const setup::version_error &) {
+		log_error << "Not a supported Inno Setup installer!";
+	}
+	return false;
+}
+
+//! Split a comma-separated list of names.
+static std::vector<std::string> split_list(const std::string & list) {
+	
+	std::vector<std::string> result;
+	
+	size_t start = 0;
+	while(start <= list.length()) {
+		size_t end = std::min(list.find(',', start), list.length());
+		std::string name = boost::algorithm::trim_copy(list.substr(start, end - start));
+		if(!name.empty()) {
+			result.push_back(name);
+		}
+		start = end + 1;
+	}
+	
+	return result;
+}
+
+/*!
+ * Parse a shard specification of the form I/N.
+ *
+ * \return false if the specification is invalid.
+ */
+static bool parse_shard(const std::string & shard, extract_options & o) {
+	
+	size_t pos = shard.find('/');
+	if(pos == std::string::npos || shard.find_first_not_of("0123456789/") != std::string::npos) {
+		return false;
+	}
+	
+	size_t index, count;
+	try {
+		index = boost::lexical_cast<size_t>(shard.substr(0, pos));
+		count = boost::lexical_cast<size_t>(shard.substr(pos + 1));
+	} catch(const boost::bad_lexical_cast &) {
+		return false;
+	}
+	if(index < 1 || index > count) {
+		return false;
+	}
+	
+	o.shard = index - 1;
+	o.shards = count;
+	
+	return true;
+}
+
+/*!
+ * Parse the options that select which files to extract.
+ *
+ * \return false if the options are invalid.
+ */
+static bool parse_filters(const po::variables_map & options, extract_options & o) {
+	
+	o.extract_temp = (options.count("exclude-temp") == 0);
+	{
+		po::variables_map::const_iterator i = options.find("language");
+		if(i != options.end()) {
+			o.language = i->second.as<std::string>();
+		}
+		o.language_only = (options.count("language-only") != 0);
+	}
+	{
+		po::variables_map::const_iterator i = options.find("variants");
+		if(i != options.end()) {
+			std::string variants = i->second.as<std::string>();
+			if(variants == "language") {
+				o.variants = LanguageVariants;
+			} else if(variants == "arch") {
+				o.variants = ArchitectureVariants;
+			} else {
+				log_error << "Unsupported --variants value: " << variants;
+				return false;
+			}
+			if(o.variants == LanguageVariants && !o.language.empty()) {
+				log_error << "Combining --variants=language with --language is not allowed";
+				return false;
+			}
+		}
+	}
+	{
+		po::variables_map::const_iterator i = options.find("type");
+		if(i != options.end()) {
+			o.setup_type = i->second.as<std::string>();
+			o.select_components = true;
+		}
+		i = options.find("components");
+		if(i != options.end()) {
+			o.components = split_list(i->second.as<std::string>());
+			o.select_components = true;
+		}
+		i = options.find("tasks");
+		if(i != options.end()) {
+			o.tasks = split_list(i->second.as<std::string>());
+			o.select_tasks = true;
+		}
+	}
+	{
+		po::variables_map::const_iterator i = options.find("include");
+		if(i != options.end()) {
+			o.include = i->second.as<std::vector <std::string> >();
+		}
+	}
+	
+	return true;
+}
+
+namespace {
+
+enum batch_status {
+	BatchPending,
+	BatchSuccess,
+	BatchWarnings,
+	BatchFailed
+};
+
+/*!
+ * Process multiple installers concurrently.
+ *
+ * Each worker thread takes the next installer from the list and processes it with its
+ * console output captured. The captured output is printed in one block once the installer
+ * is done so that the output of different installers is not interleaved.
+ */
+class batch_processor : public util::runnable {
+	
+	const std::vector<std::string> & files;
+	const extract_options & o;
+	
+	util::mutex mutex;
+	size_t next_file;
+	
+	std::vector<batch_status> status;
+	
+	size_t next() {
+		util::scoped_lock<util::mutex> lock(mutex);
+		return next_file < files.size() ? next_file++ : files.size();
+	}
+	
+public:
+	
+	batch_processor(const std::vector<std::string> & setup_files, const extract_options & options)
+		: files(setup_files), o(options), next_file(0), status(setup_files.size(), BatchPending)
+	{ }
+	
+	void run() {
+		
+		for(size_t i; (i = next()) < files.size(); ) {
+			
+			output_capture capture;
+			
+			try {
+				output_capture::scope redirect(&capture);
+				bool suggest_bug_report = false;
+				bool success = process_installer(files[i], o, suggest_bug_report);
+				if(suggest_bug_report) {
+					print_bug_report_hint();
+				}
+				if(!success || capture.errors != 0) {
+					status[i] = BatchFailed;
+				} else if(capture.warnings != 0) {
+					status[i] = BatchWarnings;
+				} else {
+					status[i] = BatchSuccess;
+				}
+			} catch(...) {
+				capture.flush();
+				throw;
+			}
+			
+			util::scoped_lock<util::recursive_mutex> lock(logger::output_mutex);
+			capture.flush();
+			if(!o.data_version && status[i] != BatchFailed) {
+				std::cout << '\n';
+			}
+			
+		}
+		
+	}
+	
+	//! Print the status of each installer, in the order they were specified.
+	void print_summary(std::ostream & os) const {
+		for(size_t i = 0; i < files.size(); i++) {
+			switch(status[i]) {
+				case BatchPending:  os << color::dim_white << "skipped "; break;
+				case BatchSuccess:  {
+					if(logger::quiet) {
+						continue;
+					}
+					os << color::green << "ok      ";
+					break;
+				}
+				case BatchWarnings: os << color::yellow << "warnings"; break;
+				case BatchFailed:   os << color::red << "failed  "; break;
+			}
+			os << color::reset << ' ' << files[i] << '\n';
+		}
+	}
+	
+};
+
+} // anonymous namespace
+
 int main(int argc, char * argv[]) {
 	
 	po::options_description generic("Generic options");
@@ -133,6 +379,8 @@ int main(int argc, char * argv[]) {
 		("test,t", "Only verify checksums, don't write anything")
 		("extract,e", "Extract files (default action)")
 		("list,l", "Only list files, don't write anything")
+		("verify-tree", "Compare extracted files with the installer checksums")
+		("plan", "Print the decompression cost as JSON, don't write anything")
 		("list-sizes", "List file sizes")
 		("list-checksums", "List file checksums")
 		("info,i", "Print information about the installer")
@@ -152,14 +400,29 @@ int main(int argc, char * argv[]) {
 		("collisions", po::value<std::string>(), "How to handle duplicate files")
 		("default-language", po::value<std::string>(), "Default language for renaming")
 		("dump", "Dump contents without converting filenames")
+		("duplicates", po::value<std::string>(), "How to create files with identical contents")
+		("skip-existing", po::value<std::string>()->implicit_value("time"),
+		 "Don't extract files that are already up to date")
 		("lowercase,L", "Convert extracted filenames to lower-case")
 		("timestamps,T", po::value<std::string>(), "Timezone for file times or \"local\" or \"none\"")
 		("output-dir,d", po::value<std::string>(), "Extract files into the given directory")
+		("stdout", "Write the contents of one file to standard output")
+		("tar", "Write a tar archive of the files to standard output")
 		("password,P", po::value<std::string>(), "Password for encrypted files")
 		("password-file", po::value<std::string>(), "File to load password from")
 		("gog,g", "Extract additional archives from GOG.com installers")
 		("no-gog-galaxy", "Don't re-assemble GOG Galaxy file parts")
 		("no-extract-unknown,n", "Don't extract unknown Inno Setup versions")
+		("jobs,j", po::value<size_t>(), "Number of threads to use for extracting files")
+		("batch", "Process multiple installers concurrently")
+		("resume", "Skip files completely extracted by an interrupted run")
+		("drop-cache", "Don't keep installer and output data in the page cache")
+		("seek-index", po::value<std::string>(), "File to store decompression checkpoints in")
+		("header-cache", po::value<std::string>(), "Directory to cache decompressed setup headers in")
+		("store", po::value<std::string>(), "Content-addressed directory to store file contents in")
+		("delta-from", po::value<std::string>(), "Only process files changed since this installer or manifest")
+		("write-manifest", po::value<std::string>(), "Write a manifest of the selected files")
+		("shard", po::value<std::string>(), "Only process shard I of N, given as I/N")
 	;
 	
 	po::options_description filter("Filters");
@@ -167,6 +430,10 @@ int main(int argc, char * argv[]) {
 		("exclude-temp,m", "Don't extract temporary files")
 		("language", po::value<std::string>(), "Extract only files for this language")
 		("language-only", "Only extract language-specific files")
+		("variants", po::value<std::string>(), "Extract one tree per language or architecture")
+		("type", po::value<std::string>(), "Extract only files installed by this setup type")
+		("components", po::value<std::string>(), "Extract only files for these components")
+		("tasks", po::value<std::string>(), "Extract only files for these tasks")
 		("include,I", po::value< std::vector<std::string> >(), "Extract only files that match this path")
 	;
 	
@@ -212,8 +479,19 @@ int main(int argc, char * argv[]) {
 	
 	::extract_options o;
 	
+	// Keep standard output free for file data, everything else goes to standard error.
+	bool stream_output = (options.count("stdout") != 0 || options.count("tar") != 0);
+	std::ostream data_output(std::cout.rdbuf());
+	if(stream_output) {
+		#ifdef _WIN32
+		std::cout.flush();
+		_setmode(_fileno(stdout), _O_BINARY);
+		#endif
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+	
 	// Verbosity settings.
-	o.silent = (options.count("silent") != 0);
+	o.silent = (options.count("silent") != 0) || (options.count("plan") != 0);
 	o.quiet = o.silent || options.count("quiet");
 	logger::quiet = o.quiet;
 #ifdef DEBUG
@@ -258,8 +536,10 @@ int main(int argc, char * argv[]) {
 	o.list_checksums = (options.count("list-checksums") != 0);
 	bool explicit_list = (options.count("list") != 0);
 	o.list = explicit_list || o.list_sizes || o.list_checksums;
-	o.extract = (options.count("extract") != 0);
+	o.extract = (options.count("extract") != 0) || stream_output;
 	o.test = (options.count("test") != 0);
+	o.verify_tree = (options.count("verify-tree") != 0);
+	o.plan = (options.count("plan") != 0);
 	o.list_languages = (options.count("list-languages") != 0);
 	o.gog_game_id = (options.count("gog-game-id") != 0);
 	o.show_password = (options.count("show-password") != 0);
@@ -269,11 +549,20 @@ int main(int argc, char * argv[]) {
 		o.gog_game_id = true;
 		o.show_password = true;
 	}
-	bool explicit_action = o.list || o.test || o.extract || o.list_languages
+	bool explicit_action = o.list || o.test || o.extract || o.verify_tree || o.plan || o.list_languages
 	                       || o.gog_game_id || o.show_password || o.check_password;
 	if(!explicit_action) {
 		o.extract = true;
 	}
+	if(o.verify_tree && (o.extract || o.test || o.list)) {
+		log_error << "Combining --verify-tree with --extract, --test or --list is not allowed";
+		return ExitUserError;
+	}
+	if(o.plan && (o.extract || o.test || o.list || o.verify_tree || o.list_languages
+	              || o.gog_game_id || o.show_password)) {
+		log_error << "Combining --plan with other actions is not allowed";
+		return ExitUserError;
+	}
 	if(!o.extract && !o.test) {
 		progress::set_enabled(false);
 	}
@@ -342,22 +631,49 @@ int main(int argc, char * argv[]) {
 			o.default_language = i->second.as<std::string>();
 		}
 	}
-	
-	o.extract_temp = (options.count("exclude-temp") == 0);
 	{
-		po::variables_map::const_iterator i = options.find("language");
+		o.duplicates = WriteDuplicates;
+		po::variables_map::const_iterator i = options.find("duplicates");
 		if(i != options.end()) {
-			o.language = i->second.as<std::string>();
+			std::string duplicates = i->second.as<std::string>();
+			if(duplicates == "write")  {
+				o.duplicates = WriteDuplicates;
+			} else if(duplicates == "copy") {
+				o.duplicates = CopyDuplicates;
+			} else if(duplicates == "reflink") {
+				o.duplicates = ReflinkDuplicates;
+			} else if(duplicates == "hardlink") {
+				o.duplicates = HardlinkDuplicates;
+			} else {
+				log_error << "Unsupported --duplicates value: " << duplicates;
+				return ExitUserError;
+			}
 		}
-		o.language_only = (options.count("language-only") != 0);
 	}
 	{
-		po::variables_map::const_iterator i = options.find("include");
+		o.existing = OverwriteExisting;
+		po::variables_map::const_iterator i = options.find("skip-existing");
 		if(i != options.end()) {
-			o.include = i->second.as<std::vector <std::string> >();
+			std::string existing = i->second.as<std::string>();
+			if(existing == "time")  {
+				o.existing = SkipExistingByTime;
+			} else if(existing == "checksum") {
+				o.existing = SkipExistingByChecksum;
+			} else {
+				log_error << "Unsupported --skip-existing value: " << existing;
+				return ExitUserError;
+			}
+			if(o.existing == SkipExistingByTime && !o.preserve_file_times) {
+				log_error << "--skip-existing=time requires file timestamps, use --skip-existing=checksum";
+				return ExitUserError;
+			}
 		}
 	}
 	
+	if(!parse_filters(options, o)) {
+		return ExitUserError;
+	}
+	
 	if(options.count("setup-files") == 0) {
 		if(!o.silent) {
 			std::cout << get_command(argv[0]) << ": no input files specified\n";
@@ -423,6 +739,25 @@ int main(int argc, char * argv[]) {
 	o.gog = (options.count("gog") != 0);
 	o.gog_galaxy = (options.count("no-gog-galaxy") == 0);
 	
+	boost::scoped_ptr<output_sink> sink;
+	if(stream_output) {
+		if(options.count("stdout") && options.count("tar")) {
+			log_error << "Combining --stdout and --tar is not allowed";
+			return ExitUserError;
+		}
+		if(o.test || o.gog || options.count("batch")) {
+			log_error << "Combining --" << (options.count("tar") ? "tar" : "stdout")
+			          << " with --test, --gog or --batch is not allowed";
+			return ExitUserError;
+		}
+		if(options.count("tar")) {
+			sink.reset(new tar_sink(data_output));
+		} else {
+			sink.reset(new raw_sink(data_output));
+		}
+		o.sink = sink.get();
+	}
+	
 	o.data_version = (options.count("data-version") != 0);
 	if(o.data_version) {
 		logger::quiet = true;
@@ -444,34 +779,127 @@ int main(int argc, char * argv[]) {
 	
 	o.extract_unknown = (options.count("no-extract-unknown") == 0);
 	
+	o.resume = (options.count("resume") != 0);
+	o.drop_cache = (options.count("drop-cache") != 0);
+	
+	{
+		po::variables_map::const_iterator i = options.find("jobs");
+		if(i != options.end()) {
+			o.jobs = i->second.as<size_t>();
+			if(o.jobs == 0) {
+				o.jobs = util::hardware_concurrency();
+			}
+			if(o.jobs > 1 && !util::have_threads()) {
+				log_warning << "Multi-threaded extraction not supported in this build, using one thread";
+				o.jobs = 1;
+			}
+		} else if((options.count("batch") || o.verify_tree) && util::have_threads()) {
+			o.jobs = util::hardware_concurrency();
+		}
+	}
+	
 	const std::vector<std::string> & files = options["setup-files"]
 	                                         .as< std::vector<std::string> >();
 	
-	bool suggest_bug_report = false;
-	try {
+	// Options that refer to the contents of a specific installer
+	const char * single_installer_options[] = {
+		"seek-index", "delta-from", "write-manifest", "shard", "plan"
+	};
+	BOOST_FOREACH(const char * option, single_installer_options) {
+		if(files.size() > 1 && options.count(option)) {
+			log_error << "--" << option << " can only be used with a single installer";
+			return ExitUserError;
+		}
+	}
+	
+	{
+		po::variables_map::const_iterator i = options.find("seek-index");
+		if(i != options.end()) {
+			o.seek_index = i->second.as<std::string>();
+		}
+	}
+	
+	{
+		po::variables_map::const_iterator i = options.find("header-cache");
+		if(i != options.end()) {
+			o.header_cache = i->second.as<std::string>();
+		}
+	}
+	
+	{
+		po::variables_map::const_iterator i = options.find("store");
+		if(i != options.end()) {
+			o.store = i->second.as<std::string>();
+		}
+	}
+	
+	{
+		po::variables_map::const_iterator i = options.find("delta-from");
+		if(i != options.end()) {
+			o.delta_from = i->second.as<std::string>();
+		}
+	}
+	
+	{
+		po::variables_map::const_iterator i = options.find("write-manifest");
+		if(i != options.end()) {
+			o.manifest = i->second.as<std::string>();
+		}
+	}
+	
+	{
+		po::variables_map::const_iterator i = options.find("shard");
+		if(i != options.end()) {
+			if(!parse_shard(i->second.as<std::string>(), o)) {
+				log_error << "Invalid --shard value: " << i->second.as<std::string>()
+				          << " - expected I/N with 1 <= I <= N";
+				return ExitUserError;
+			}
+		}
+	}
+	
+	if(options.count("batch")) {
+		
+		// Share the thread budget between installers before splitting up individual ones
+		size_t threads = std::min(o.jobs, files.size());
+		::extract_options installer_options = o;
+		installer_options.jobs = std::max(o.jobs / threads, size_t(1));
+		
+		progress::set_enabled(false);
+		output_capture::install();
+		
+		batch_processor processor(files, installer_options);
+		util::run_threads(processor, threads);
+		
+		std::ostream & os = logger::quiet ? std::cerr : std::cout;
+		processor.print_summary(os);
+		
+	} else {
+		
+		bool suggest_bug_report = false;
+		bool success = true;
 		BOOST_FOREACH(const std::string & file, files) {
-			process_file(file, o);
+			if(!process_installer(file, o, suggest_bug_report)) {
+				success = false;
+				break;
+			}
 			if(!o.data_version && files.size() > 1) {
 				std::cout << '\n';
 			}
 		}
-	} catch(const std::ios_base::failure & e) {
-		log_error << "Stream error while extracting files!\n"
-		          << " └─ error reason: " << e.what();
-		suggest_bug_report = true;
-	} catch(const format_error & e) {
-		log_error << e.what();
-		suggest_bug_report = true;
-	} catch(const std::runtime_error & e) {
-		log_error << e.what();
-	} catch(const setup::version_error &) {
-		log_error << "Not a supported Inno Setup installer!";
-	}
-	
-	if(suggest_bug_report) {
-		std::cerr << color::blue << "If you are sure the setup file is not corrupted,"
-		          << " consider \nfiling a bug report at "
-		          << color::dim_cyan << innoextract_bugs << color::reset << '\n';
+		
+		if(success && sink) {
+			try {
+				sink->finish();
+			} catch(const std::runtime_error & e) {
+				log_error << e.what();
+			}
+		}
+		
+		if(suggest_bug_report) {
+			print_bug_report_hint();
+		}
+		
 	}
 	
 	if(!logger::quiet || logger::total_errors || logger::total_warnings) {
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "cli/manifest.hpp"
+
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "crypto/checksum.hpp"
+#include "setup/data.hpp"
+#include "setup/file.hpp"
+#include "setup/info.hpp"
+#include "util/fstream.hpp"
+
+namespace {
+
+const char manifest_magic[] = "innoextract manifest 1";
+
+const char shard_prefix[] = "shard ";
+const char installer_prefix[] = "installer ";
+
+} // anonymous namespace
+
+void file_manifest::add(const std::string & path, const setup::info & info,
+                        const setup::file_entry & file) {
+	
+	std::ostringstream oss;
+	
+	std::vector<boost::uint32_t> locations(1, file.location);
+	locations.insert(locations.end(), file.additional_locations.begin(), file.additional_locations.end());
+	for(size_t i = 0; i < locations.size(); i++) {
+		const setup::data_entry & data = info.data_entries[locations[i]];
+		if(i != 0) {
+			oss << "; ";
+		}
+		oss << data.uncompressed_size << ' ' << data.file.checksum;
+		if(data.options & setup::data_entry::VersionInfoValid) {
+			oss << " v" << std::hex << data.file_version << std::dec;
+		}
+	}
+	
+	files_[path] = oss.str();
+}
+
+bool file_manifest::load(const boost::filesystem::path & path) {
+	
+	util::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+	
+	std::string line;
+	if(!std::getline(ifs, line) || line != manifest_magic) {
+		return false;
+	}
+	
+	std::set<size_t> loaded_shards;
+	bool complete = true;
+	
+	while(std::getline(ifs, line)) {
+		
+		size_t separator = line.find('\t');
+		if(separator != std::string::npos) {
+			files_[line.substr(separator + 1)] = line.substr(0, separator);
+			continue;
+		}
+		
+		if(boost::starts_with(line, shard_prefix)) {
+			std::istringstream iss(line.substr(sizeof(shard_prefix) - 1));
+			size_t index = 0, count = 0, files = 0;
+			char slash = 0;
+			if(!(iss >> index >> slash >> count >> files) || slash != '/' || index == 0 || index > count
+			   || (shards != 0 && (count != shards || files != total))) {
+				complete = false;
+			}
+			shards = count, total = files;
+			if(!loaded_shards.insert(index).second) {
+				complete = false;
+			}
+		} else if(boost::starts_with(line, installer_prefix)) {
+			std::string identity = line.substr(sizeof(installer_prefix) - 1);
+			if(!installer.empty() && identity != installer) {
+				complete = false;
+			}
+			installer = identity;
+		}
+		
+	}
+	
+	if(shards != 0 && (!complete || loaded_shards.size() != shards || files_.size() != total)) {
+		throw std::runtime_error("\"" + path.string() + "\" does not contain the manifests of all "
+		                         "shards of one installer");
+	}
+	
+	return true;
+}
+
+void file_manifest::save(const boost::filesystem::path & path) const {
+	
+	util::ofstream ofs(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	
+	ofs << manifest_magic << '\n';
+	if(shards != 0) {
+		ofs << shard_prefix << (shard + 1) << '/' << shards << ' ' << total << '\n';
+		ofs << installer_prefix << installer << '\n';
+	}
+	BOOST_FOREACH(const Files::value_type & file, files_) {
+		ofs << file.second << '\t' << file.first << '\n';
+	}
+	ofs.flush();
+	
+	if(!ofs.is_open() || ofs.fail()) {
+		throw std::runtime_error("Could not write manifest \"" + path.string() + '"');
+	}
+	
+}
+
+const std::string * file_manifest::find(const std::string & path) const {
+	
+	Files::const_iterator i = files_.find(path);
+	
+	return (i == files_.end()) ? NULL : &i->second;
+}
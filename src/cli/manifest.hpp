@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Lists of extracted files and their contents used to compare installer versions.
+ */
+#ifndef INNOEXTRACT_CLI_MANIFEST_HPP
+#define INNOEXTRACT_CLI_MANIFEST_HPP
+
+#include <stddef.h>
+#include <map>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+namespace setup {
+struct file_entry;
+struct info;
+}
+
+/*!
+ * Output paths of the files in an installer together with a signature of their contents.
+ *
+ * The signature consists of the size, checksum and version of each data entry of a file
+ * and can be compared without decompressing anything.
+ */
+class file_manifest {
+	
+public:
+	
+	typedef std::map<std::string, std::string> Files; //!< Signatures by output path
+	
+	file_manifest() : shard(0), shards(0), total(0) { }
+	
+	/*!
+	 * Mark the manifest as one of several shards that together list all selected files.
+	 *
+	 * \param index    The zero-based index of this shard.
+	 * \param count    The total number of shards.
+	 * \param files    The number of files in all shards combined.
+	 * \param identity String identifying the installer the shards were created from.
+	 */
+	void set_shard(size_t index, size_t count, size_t files, const std::string & identity) {
+		shard = index, shards = count, total = files, installer = identity;
+	}
+	
+	//! Add a file to the manifest.
+	void add(const std::string & path, const setup::info & info, const setup::file_entry & file);
+	
+	/*!
+	 * Load a manifest file written by \ref save.
+	 *
+	 * The manifests of all shards of an installer can be concatenated and loaded as one.
+	 *
+	 * \return false if the file is not a manifest file.
+	 *
+	 * \throws std::runtime_error if the file contains shard manifests that don't make up
+	 *         one complete set.
+	 */
+	bool load(const boost::filesystem::path & path);
+	
+	/*!
+	 * Write the manifest to a file.
+	 *
+	 * \throws std::runtime_error if the file could not be written.
+	 */
+	void save(const boost::filesystem::path & path) const;
+	
+	//! \return the signature of a file or \c NULL if it is not in the manifest.
+	const std::string * find(const std::string & path) const;
+	
+	const Files & files() const { return files_; }
+	
+private:
+	
+	Files files_;
+	
+	size_t shard;
+	size_t shards;
+	size_t total;
+	std::string installer;
+	
+};
+
+#endif // INNOEXTRACT_CLI_MANIFEST_HPP
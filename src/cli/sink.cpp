@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "cli/sink.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/static_assert.hpp>
+
+#include "setup/filename.hpp"
+
+void raw_sink::add_directory(const std::string & path, util::time mtime) {
+	(void)path, (void)mtime;
+}
+
+void raw_sink::begin_file(const std::string & path, boost::uint64_t size, util::time mtime,
+                          boost::uint32_t nsec) {
+	(void)path, (void)size, (void)mtime, (void)nsec;
+}
+
+bool raw_sink::write(const char * data, size_t size) {
+	os.write(data, std::streamsize(size));
+	return !os.fail();
+}
+
+void raw_sink::end_file() { }
+
+void raw_sink::add_link(const std::string & path, const std::string & target, util::time mtime) {
+	(void)path, (void)target, (void)mtime;
+}
+
+void raw_sink::finish() {
+	os.flush();
+}
+
+namespace {
+
+const size_t tar_block_size = 512;
+
+struct ustar_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char type;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char padding[12];
+};
+
+BOOST_STATIC_ASSERT(sizeof(ustar_header) == tar_block_size);
+
+/*!
+ * Store a number as a zero-padded and NUL-terminated octal string.
+ *
+ * \return false if the value does not fit into the field.
+ */
+template <size_t N>
+bool set_octal(char (&field)[N], boost::uint64_t value) {
+	char * p = field + N - 1;
+	*p = '\0';
+	while(p != field) {
+		*--p = char('0' + (value & 7));
+		value >>= 3;
+	}
+	return value == 0;
+}
+
+template <size_t N>
+void set_string(char (&field)[N], const std::string & value) {
+	std::memcpy(field, value.data(), std::min(value.size(), N));
+}
+
+bool is_ascii(const std::string & str) {
+	for(size_t i = 0; i < str.size(); i++) {
+		if(static_cast<unsigned char>(str[i]) >= 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Split a path into the ustar prefix and name fields.
+bool split_path(const std::string & path, ustar_header & header) {
+	
+	if(!is_ascii(path)) {
+		return false;
+	}
+	
+	if(path.size() <= sizeof(header.name)) {
+		set_string(header.name, path);
+		return true;
+	}
+	
+	size_t pos = path.find('/', path.size() - sizeof(header.name) - 1);
+	if(pos == std::string::npos || pos == 0 || pos > sizeof(header.prefix)) {
+		return false;
+	}
+	
+	set_string(header.prefix, path.substr(0, pos));
+	set_string(header.name, path.substr(pos + 1));
+	return true;
+}
+
+//! Append a pax extended header record.
+void add_record(std::string & records, const std::string & key, const std::string & value) {
+	
+	// The length includes its own decimal representation
+	size_t size = key.size() + value.size() + 3;
+	size_t length = size + 1;
+	for(;;) {
+		std::ostringstream oss;
+		oss << length;
+		if(size + oss.str().size() == length) {
+			break;
+		}
+		length = size + oss.str().size();
+	}
+	
+	std::ostringstream oss;
+	oss << length << ' ' << key << '=' << value << '\n';
+	records += oss.str();
+}
+
+void init_header(ustar_header & header, char type, boost::uint32_t mode) {
+	std::memset(&header, 0, sizeof(header));
+	set_octal(header.mode, mode);
+	set_octal(header.uid, 0);
+	set_octal(header.gid, 0);
+	header.type = type;
+	std::memcpy(header.magic, "ustar", sizeof(header.magic));
+	std::memcpy(header.version, "00", sizeof(header.version));
+}
+
+void set_checksum(ustar_header & header) {
+	std::memset(header.checksum, ' ', sizeof(header.checksum));
+	boost::uint32_t checksum = 0;
+	const unsigned char * bytes = reinterpret_cast<const unsigned char *>(&header);
+	for(size_t i = 0; i < sizeof(header); i++) {
+		checksum += bytes[i];
+	}
+	set_octal(header.checksum, checksum);
+}
+
+std::string to_tar_path(const std::string & path) {
+	std::string result = path;
+	std::replace(result.begin(), result.end(), setup::path_sep, '/');
+	return result;
+}
+
+} // anonymous namespace
+
+void tar_sink::write_entry(char type, const std::string & path, boost::uint64_t size,
+                           util::time mtime, boost::uint32_t nsec, const std::string & link) {
+	
+	ustar_header header;
+	init_header(header, type, type == '5' ? 0755 : 0644);
+	
+	std::string records;
+	
+	if(!split_path(path, header)) {
+		add_record(records, "path", path);
+		set_string(header.name, path.substr(0, sizeof(header.name)));
+	}
+	
+	if(!link.empty() && (link.size() > sizeof(header.linkname) || !is_ascii(link))) {
+		add_record(records, "linkpath", link);
+	}
+	set_string(header.linkname, link);
+	
+	if(!set_octal(header.size, size)) {
+		std::ostringstream oss;
+		oss << size;
+		add_record(records, "size", oss.str());
+		set_octal(header.size, 0);
+	}
+	
+	if(mtime < 0 || !set_octal(header.mtime, boost::uint64_t(mtime)) || nsec != 0) {
+		std::ostringstream oss;
+		oss << mtime;
+		if(nsec != 0 && mtime >= 0) {
+			oss << '.';
+			oss.width(9);
+			oss.fill('0');
+			oss << nsec;
+		}
+		add_record(records, "mtime", oss.str());
+		if(mtime < 0 || !set_octal(header.mtime, boost::uint64_t(mtime))) {
+			set_octal(header.mtime, 0);
+		}
+	}
+	
+	if(!records.empty()) {
+		
+		ustar_header extended;
+		init_header(extended, 'x', 0644);
+		
+		std::string name = path;
+		size_t pos = name.find_last_of('/', name.size() - 2);
+		if(pos != std::string::npos) {
+			name = name.substr(pos + 1);
+		}
+		if(!is_ascii(name)) {
+			name = "entry";
+		}
+		set_string(extended.name, "PaxHeaders/" + name);
+		set_octal(extended.size, records.size());
+		std::memcpy(extended.mtime, header.mtime, sizeof(extended.mtime));
+		set_checksum(extended);
+		
+		os.write(reinterpret_cast<const char *>(&extended), std::streamsize(sizeof(extended)));
+		os.write(records.data(), std::streamsize(records.size()));
+		write_padding((tar_block_size - records.size() % tar_block_size) % tar_block_size);
+		
+	}
+	
+	set_checksum(header);
+	os.write(reinterpret_cast<const char *>(&header), std::streamsize(sizeof(header)));
+	
+	if(os.fail()) {
+		throw std::runtime_error("Error writing tar header for \"" + path + '"');
+	}
+	
+}
+
+void tar_sink::write_padding(size_t size) {
+	static const char zeros[tar_block_size] = { 0 };
+	while(size > 0) {
+		size_t n = std::min(size, sizeof(zeros));
+		os.write(zeros, std::streamsize(n));
+		size -= n;
+	}
+}
+
+void tar_sink::add_directory(const std::string & path, util::time mtime) {
+	write_entry('5', to_tar_path(path) + '/', 0, mtime, 0);
+}
+
+void tar_sink::begin_file(const std::string & path, boost::uint64_t size, util::time mtime,
+                          boost::uint32_t nsec) {
+	write_entry('0', to_tar_path(path), size, mtime, nsec);
+	remaining = size;
+	padding = size_t((tar_block_size - size % tar_block_size) % tar_block_size);
+}
+
+bool tar_sink::write(const char * data, size_t size) {
+	// Never write more than was announced in the header
+	size_t n = size_t(std::min(boost::uint64_t(size), remaining));
+	os.write(data, std::streamsize(n));
+	remaining -= n;
+	return !os.fail();
+}
+
+void tar_sink::end_file() {
+	
+	// Fill up truncated files to keep the archive readable
+	while(remaining > 0) {
+		size_t n = size_t(std::min(boost::uint64_t(tar_block_size), remaining));
+		write_padding(n);
+		remaining -= n;
+	}
+	
+	write_padding(padding);
+	padding = 0;
+	
+	if(os.fail()) {
+		throw std::runtime_error("Error writing tar data");
+	}
+	
+}
+
+void tar_sink::add_link(const std::string & path, const std::string & target, util::time mtime) {
+	write_entry('1', to_tar_path(path), 0, mtime, 0, to_tar_path(target));
+}
+
+void tar_sink::finish() {
+	write_padding(2 * tar_block_size);
+	os.flush();
+	if(os.fail()) {
+		throw std::runtime_error("Error writing tar data");
+	}
+}
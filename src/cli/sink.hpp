@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Output sinks for streaming extracted files instead of writing them to a directory.
+ */
+#ifndef INNOEXTRACT_CLI_SINK_HPP
+#define INNOEXTRACT_CLI_SINK_HPP
+
+#include <stddef.h>
+#include <ostream>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "util/time.hpp"
+
+/*!
+ * Sequential destination for extracted files.
+ *
+ * Files are added one at a time: \ref begin_file() is followed by exactly the announced
+ * number of bytes in one or more \ref write() calls and then \ref end_file().
+ */
+class output_sink : private boost::noncopyable {
+	
+public:
+	
+	virtual ~output_sink() { }
+	
+	//! \return true if the sink can only hold a single file.
+	virtual bool single_file() const { return false; }
+	
+	//! Add an empty directory.
+	virtual void add_directory(const std::string & path, util::time mtime) = 0;
+	
+	/*!
+	 * Start a new file.
+	 *
+	 * \param path  Path of the file, using \ref setup::path_sep as the separator.
+	 * \param size  Number of bytes that will be written for this file.
+	 * \param mtime Modification time of the file.
+	 * \param nsec  Sub-second part of the modification time.
+	 */
+	virtual void begin_file(const std::string & path, boost::uint64_t size,
+	                        util::time mtime, boost::uint32_t nsec) = 0;
+	
+	/*!
+	 * Write data for the current file.
+	 *
+	 * \return false if there was an error writing to the underlying stream.
+	 */
+	virtual bool write(const char * data, size_t size) = 0;
+	
+	//! Finish the current file.
+	virtual void end_file() = 0;
+	
+	/*!
+	 * Add a file that has the same contents as a file that was already added.
+	 *
+	 * \param path   Path of the new file.
+	 * \param target Path of the existing file.
+	 * \param mtime  Modification time of the new file.
+	 */
+	virtual void add_link(const std::string & path, const std::string & target, util::time mtime) = 0;
+	
+	//! Complete the output after all files have been added.
+	virtual void finish() = 0;
+	
+};
+
+//! Write the contents of a single file to a stream.
+class raw_sink : public output_sink {
+	
+	std::ostream & os;
+	
+public:
+	
+	explicit raw_sink(std::ostream & output) : os(output) { }
+	
+	bool single_file() const { return true; }
+	
+	void add_directory(const std::string & path, util::time mtime);
+	void begin_file(const std::string & path, boost::uint64_t size, util::time mtime, boost::uint32_t nsec);
+	bool write(const char * data, size_t size);
+	void end_file();
+	void add_link(const std::string & path, const std::string & target, util::time mtime);
+	void finish();
+	
+};
+
+/*!
+ * Write files as a POSIX.1-2001 (pax) tar archive.
+ *
+ * Paths, sizes and timestamps that don't fit into the ustar header are stored in pax
+ * extended headers. Duplicate files are stored as hard links.
+ */
+class tar_sink : public output_sink {
+	
+	std::ostream & os;
+	
+	boost::uint64_t remaining; //!< Bytes still expected for the current file.
+	size_t padding;            //!< Bytes needed to fill the last block of the current file.
+	
+	void write_entry(char type, const std::string & path, boost::uint64_t size,
+	                 util::time mtime, boost::uint32_t nsec,
+	                 const std::string & link = std::string());
+	
+	void write_padding(size_t size);
+	
+public:
+	
+	explicit tar_sink(std::ostream & output) : os(output), remaining(0), padding(0) { }
+	
+	void add_directory(const std::string & path, util::time mtime);
+	void begin_file(const std::string & path, boost::uint64_t size, util::time mtime, boost::uint32_t nsec);
+	bool write(const char * data, size_t size);
+	void end_file();
+	void add_link(const std::string & path, const std::string & target, util::time mtime);
+	void finish();
+	
+};
+
+#endif // INNOEXTRACT_CLI_SINK_HPP
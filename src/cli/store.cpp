@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "cli/store.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/range/size.hpp>
+
+#include "setup/data.hpp"
+#include "util/copy.hpp"
+#include "util/log.hpp"
+#include "util/output.hpp"
+#include "util/storage.hpp"
+
+namespace fs = boost::filesystem;
+
+content_store::content_store(const fs::path & dir) : root(dir) {
+	
+	try {
+		fs::create_directories(root);
+	} catch(...) {
+		throw std::runtime_error("Could not create store directory \"" + root.string() + '"');
+	}
+	
+}
+
+bool content_store::is_storable(const setup::data_entry & data) {
+	
+	if(data.file.filter == stream::ZlibFilter) {
+		return false; // Checksum is for the compressed data
+	}
+	
+	switch(data.file.checksum.type) {
+		case crypto::MD5: case crypto::SHA1: case crypto::SHA256: return true;
+		default: return false;
+	}
+	
+}
+
+fs::path content_store::blob(const setup::data_entry & data) const {
+	
+	if(!is_storable(data)) {
+		return fs::path();
+	}
+	
+	const crypto::checksum & checksum = data.file.checksum;
+	const char * type;
+	std::ostringstream digest;
+	switch(checksum.type) {
+		case crypto::MD5: {
+			type = "md5", digest << print_hex(checksum.md5, size_t(boost::size(checksum.md5)));
+			break;
+		}
+		case crypto::SHA1: {
+			type = "sha1", digest << print_hex(checksum.sha1, size_t(boost::size(checksum.sha1)));
+			break;
+		}
+		default: {
+			type = "sha256", digest << print_hex(checksum.sha256, size_t(boost::size(checksum.sha256)));
+			break;
+		}
+	}
+	
+	std::ostringstream name;
+	name << digest.str() << '-' << data.uncompressed_size;
+	
+	return root / type / digest.str().substr(0, 2) / name.str();
+}
+
+bool content_store::contains(const setup::data_entry & data) const {
+	
+	fs::path path = blob(data);
+	if(path.empty()) {
+		return false;
+	}
+	
+	boost::system::error_code ec;
+	return fs::file_size(path, ec) == data.uncompressed_size && !ec;
+}
+
+bool content_store::link(const setup::data_entry & data, const fs::path & target) const {
+	
+	return contains(data) && util::clone_file(blob(data), target, util::CloneHardlink);
+}
+
+void content_store::add(const setup::data_entry & data, const fs::path & file) const {
+	
+	fs::path path = blob(data);
+	if(path.empty() || fs::exists(path)) {
+		return;
+	}
+	
+	boost::system::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	
+	// Add the file under a temporary name first so that incomplete copies are never used
+	fs::path temporary = path.string() + '.' + fs::unique_path().string();
+	if(ec || !util::clone_file(file, temporary, util::CloneHardlink)) {
+		fs::remove(temporary, ec);
+		log_warning << "Could not add \"" << file.string() << "\" to the store";
+		return;
+	}
+	
+	// Protect the contents shared by all linked files from being modified in place
+	util::make_read_only(temporary);
+	
+	fs::rename(temporary, path, ec);
+	if(ec) {
+		fs::remove(temporary, ec);
+		log_warning << "Could not add \"" << file.string() << "\" to the store";
+	}
+	
+}
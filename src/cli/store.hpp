@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Content-addressed store for extracted file contents.
+ */
+#ifndef INNOEXTRACT_CLI_STORE_HPP
+#define INNOEXTRACT_CLI_STORE_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace setup { struct data_entry; }
+
+/*!
+ * Directory of file contents keyed by their checksum and size.
+ *
+ * Output files are created as links to the stored contents, so identical files from
+ * different installers only need to be decompressed and stored once.
+ *
+ * Only data with a cryptographic checksum of the final file contents can be stored.
+ * Contents are added atomically, so the same store can be used by multiple processes
+ * concurrently.
+ *
+ * Stored contents are made read-only. As linked files share the stored contents, they
+ * must be replaced and not modified in place. They also share a single modification
+ * time: that of the file the contents were first added from.
+ */
+class content_store : private boost::noncopyable {
+	
+	boost::filesystem::path root;
+	
+	//! \return the path for the data in the store or an empty path if it cannot be stored.
+	boost::filesystem::path blob(const setup::data_entry & data) const;
+	
+public:
+	
+	//! Open a store directory, creating it if it does not exist.
+	explicit content_store(const boost::filesystem::path & dir);
+	
+	//! \return true if data with the checksum and size of a data entry can be stored.
+	static bool is_storable(const setup::data_entry & data);
+	
+	//! \return true if the store contains the contents described by a data entry.
+	bool contains(const setup::data_entry & data) const;
+	
+	/*!
+	 * Create a file from stored contents.
+	 *
+	 * \param data   The data entry describing the contents.
+	 * \param target The file to create. Existing files are replaced.
+	 *
+	 * \return false if the contents are not in the store or the file could not be created.
+	 */
+	bool link(const setup::data_entry & data, const boost::filesystem::path & target) const;
+	
+	/*!
+	 * Add an extracted file to the store.
+	 *
+	 * The file is hard-linked into the store if possible and copied otherwise, and made
+	 * read-only. Nothing is done if the store already contains the contents.
+	 *
+	 * \param data The data entry describing the contents.
+	 * \param file A completely written and verified file with the contents of the data entry.
+	 */
+	void add(const setup::data_entry & data, const boost::filesystem::path & file) const;
+	
+};
+
+#endif // INNOEXTRACT_CLI_STORE_HPP
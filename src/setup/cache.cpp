@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "setup/cache.hpp"
+
+#include <cstring>
+#include <istream>
+#include <sstream>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/range/size.hpp>
+
+#include "crypto/hasher.hpp"
+#include "release.hpp"
+#include "stream/block.hpp"
+#include "util/console.hpp"
+#include "util/endian.hpp"
+#include "util/fstream.hpp"
+#include "util/load.hpp"
+#include "util/log.hpp"
+#include "util/output.hpp"
+#include "util/process.hpp"
+#include "util/thread.hpp"
+
+namespace fs = boost::filesystem;
+namespace io = boost::iostreams;
+
+namespace setup {
+
+namespace {
+
+const char cache_magic[8] = { 'i', 'e', 'h', 'd', 'r', 0x1a, 0, 1 };
+
+//! Size of the fixed part after the identity: version, variant, known flag and block sizes
+const size_t fixed_size = 4 + 1 + 1 + 8 + 8;
+
+typedef io::stream<io::array_source> block_stream;
+
+//! Protects \ref temporary_counter.
+util::mutex temporary_mutex;
+
+//! Number of temporary files created by this process.
+boost::uint32_t temporary_counter = 0;
+
+template <class T>
+void store_value(std::ostream & os, T value) {
+	char buffer[sizeof(T)];
+	util::little_endian::store(value, buffer);
+	os.write(buffer, std::streamsize(sizeof(buffer)));
+}
+
+boost::uint8_t store_variant(const version::flags & variant) {
+	return boost::uint8_t(((variant & version::Bits16) ? 1 : 0)
+	                    | ((variant & version::Unicode) ? 2 : 0)
+	                    | ((variant & version::ISX) ? 4 : 0));
+}
+
+version::flags load_variant(boost::uint8_t value) {
+	version::flags variant = 0;
+	variant |= (value & 1) ? version::flags(version::Bits16) : version::flags(0);
+	variant |= (value & 2) ? version::flags(version::Unicode) : version::flags(0);
+	variant |= (value & 4) ? version::flags(version::ISX) : version::flags(0);
+	return variant;
+}
+
+} // anonymous namespace
+
+header_cache::header_cache(const fs::path & dir, const fs::path & installer,
+                           std::istream & is, boost::uint32_t header_offset) {
+	
+	// Find the end of the header region without decompressing it
+	is.seekg(header_offset);
+	stored_version.load(is);
+	stream::block_reader::skip(is, stored_version);
+	stream::block_reader::skip(is, stored_version);
+	boost::uint64_t size = boost::uint64_t(is.tellg()) - header_offset;
+	
+	crypto::hasher hash(crypto::SHA1);
+	is.seekg(header_offset);
+	char buffer[8192];
+	while(size != 0) {
+		std::streamsize n = std::streamsize(std::min(boost::uint64_t(sizeof(buffer)), size));
+		if(is.read(buffer, n).fail()) {
+			throw std::ios_base::failure("could not read setup headers");
+		}
+		hash.update(buffer, size_t(n));
+		size -= boost::uint64_t(n);
+	}
+	is.seekg(header_offset);
+	
+	crypto::checksum checksum = hash.finalize();
+	std::ostringstream oss;
+	oss << innoextract_version << ':' << fs::file_size(installer) << ':'
+	    << fs::last_write_time(installer) << ':' << header_offset << ':'
+	    << print_hex(checksum.sha1, size_t(boost::size(checksum.sha1)));
+	identity = oss.str();
+	
+	crypto::hasher name_hash(crypto::SHA1);
+	name_hash.update(identity.data(), identity.size());
+	crypto::checksum name = name_hash.finalize();
+	std::ostringstream filename;
+	filename << print_hex(name.sha1, size_t(boost::size(name.sha1))) << ".hdr";
+	
+	boost::system::error_code ec;
+	fs::create_directories(dir, ec);
+	if(ec) {
+		log_warning << "Could not create header cache directory \"" << dir.string() << '"';
+		return;
+	}
+	
+	path = dir / filename.str();
+	
+}
+
+bool header_cache::load(info & result, info::entry_types entries,
+                        util::codepage_id force_codepage) {
+	
+	if(path.empty()) {
+		return false;
+	}
+	
+	if(!fs::exists(path)) {
+		debug("[no cached setup headers in " << path << ']');
+		return false;
+	}
+	
+	try {
+		
+		io::mapped_file_source file(path.string());
+		const char * data = file.data();
+		size_t size = file.size();
+		
+		size_t header_size = sizeof(cache_magic) + 4 + identity.size() + fixed_size;
+		if(size < header_size || std::memcmp(data, cache_magic, sizeof(cache_magic)) != 0
+		   || util::little_endian::load<boost::uint32_t>(data + sizeof(cache_magic)) != identity.size()
+		   || std::memcmp(data + sizeof(cache_magic) + 4, identity.data(), identity.size()) != 0) {
+			log_warning << "Ignoring invalid header cache file \"" << path.string() << '"';
+			return false;
+		}
+		const char * p = data + sizeof(cache_magic) + 4 + identity.size();
+		
+		setup::version version;
+		version.value = util::little_endian::load<boost::uint32_t>(p);
+		version.variant = load_variant(util::little_endian::load<boost::uint8_t>(p + 4));
+		version.known = (util::little_endian::load<boost::uint8_t>(p + 5) != 0);
+		boost::uint64_t primary_size = util::little_endian::load<boost::uint64_t>(p + 6);
+		boost::uint64_t secondary_size = util::little_endian::load<boost::uint64_t>(p + 14);
+		p += fixed_size;
+		
+		if(primary_size > size - header_size || secondary_size > size - header_size - primary_size) {
+			log_warning << "Ignoring truncated header cache file \"" << path.string() << '"';
+			return false;
+		}
+		
+		if(!version.known && (entries & info::NoUnknownVersion)) {
+			// Let the normal loader report the error
+			return false;
+		}
+		
+		block_stream primary(p, size_t(primary_size));
+		primary.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		block_stream secondary(p + primary_size, size_t(secondary_size));
+		secondary.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		
+		result.load(version, primary, secondary, entries, force_codepage);
+		
+		if(!stored_version.known) {
+			// Same warning as info::load, for the version listed in the installer
+			log_warning << "Unexpected setup data version: "
+			            << color::white << stored_version << color::reset;
+		}
+		
+	} catch(const std::exception & e) {
+		log_warning << "Could not load cached setup headers from \"" << path.string() << "\": "
+		            << e.what();
+		return false;
+	}
+	
+	debug("[loaded setup headers from " << path << ']');
+	
+	return true;
+}
+
+void header_cache::store(const setup::version & setup_version, const info::header_blocks & blocks) {
+	
+	if(path.empty()) {
+		return;
+	}
+	
+	// Use a unique temporary file so that concurrent writers don't clobber each other
+	std::ostringstream suffix;
+	{
+		util::scoped_lock<util::mutex> lock(temporary_mutex);
+		suffix << '.' << util::process_id() << '.' << temporary_counter++ << ".tmp";
+	}
+	fs::path temporary = path.string() + suffix.str();
+	boost::system::error_code ec;
+	
+	{
+		util::ofstream ofs(temporary, std::ios_base::out | std::ios_base::binary
+		                              | std::ios_base::trunc);
+		
+		ofs.write(cache_magic, std::streamsize(sizeof(cache_magic)));
+		store_value(ofs, boost::uint32_t(identity.size()));
+		ofs.write(identity.data(), std::streamsize(identity.size()));
+		store_value(ofs, boost::uint32_t(setup_version.value));
+		store_value(ofs, store_variant(setup_version.variant));
+		store_value(ofs, boost::uint8_t(setup_version.known ? 1 : 0));
+		store_value(ofs, boost::uint64_t(blocks.primary.size()));
+		store_value(ofs, boost::uint64_t(blocks.secondary.size()));
+		ofs.write(blocks.primary.data(), std::streamsize(blocks.primary.size()));
+		ofs.write(blocks.secondary.data(), std::streamsize(blocks.secondary.size()));
+		ofs.flush();
+		
+		if(!ofs.is_open() || ofs.fail()) {
+			log_warning << "Could not write header cache file \"" << temporary.string() << '"';
+			ofs.close();
+			fs::remove(temporary, ec);
+			return;
+		}
+	}
+	
+	// Replace atomically so that concurrent runs never see partial files
+	fs::rename(temporary, path, ec);
+	if(ec) {
+		log_warning << "Could not write header cache file \"" << path.string() << '"';
+		fs::remove(temporary, ec);
+		return;
+	}
+	
+	debug("[stored setup headers in " << path << ']');
+	
+}
+
+} // namespace setup
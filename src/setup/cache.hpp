@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * On-disk cache for decompressed setup headers.
+ */
+#ifndef INNOEXTRACT_SETUP_CACHE_HPP
+#define INNOEXTRACT_SETUP_CACHE_HPP
+
+#include <iosfwd>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include "setup/info.hpp"
+#include "setup/version.hpp"
+
+namespace setup {
+
+/*!
+ * Cache of the decompressed setup header blocks for an installer.
+ *
+ * Cache files are keyed by the installer size, modification time and a hash of the
+ * compressed header region. They store the resolved setup data version together with
+ * the decompressed header block streams so that later runs can skip decompression and
+ * the version detection heuristics. Cache files are memory-mapped when loading.
+ */
+class header_cache {
+	
+public:
+	
+	/*!
+	 * Locate the cache file for an installer.
+	 *
+	 * \param dir           Directory containing the cache files. Created if it doesn't exist.
+	 * \param installer     Path to the installer file.
+	 * \param is            Stream for the installer file.
+	 * \param header_offset Offset of the setup headers in \c is.
+	 *
+	 * The stream is positioned at \c header_offset when this function returns.
+	 *
+	 * \throws version_error if the setup data version could not be determined.
+	 */
+	header_cache(const boost::filesystem::path & dir, const boost::filesystem::path & installer,
+	             std::istream & is, boost::uint32_t header_offset);
+	
+	/*!
+	 * Load setup headers from the cache.
+	 *
+	 * \return \c true if the headers were loaded or \c false if there is no usable cache
+	 *         entry. In the latter case \c result may be partially loaded and must be
+	 *         loaded again using \ref info::load.
+	 */
+	bool load(info & result, info::entry_types entries, util::codepage_id force_codepage);
+	
+	/*!
+	 * Store setup headers in the cache.
+	 *
+	 * \param setup_version The resolved setup data version.
+	 * \param blocks        The decompressed header blocks as returned by \ref info::load.
+	 */
+	void store(const setup::version & setup_version, const info::header_blocks & blocks);
+	
+private:
+	
+	std::string identity;
+	boost::filesystem::path path;
+	
+	version stored_version; //!< The version listed in the installer, before any heuristics.
+	
+};
+
+} // namespace setup
+
+#endif // INNOEXTRACT_SETUP_CACHE_HPP
@@ -39,9 +39,27 @@ bool is_identifier(char c) {
 	return is_identifier_start(c) || (c >= '0' && c <= '9') || c == '\\';
 }
 
+char ascii_tolower(char c) {
+	return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+//! Inno Setup names are not case-sensitive
+bool identifier_equals(const std::string & test, const char * name, size_t length) {
+	if(test.length() != length) {
+		return false;
+	}
+	for(size_t i = 0; i < length; i++) {
+		if(ascii_tolower(test[i]) != ascii_tolower(name[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
 struct evaluator {
 	
-	const std::string & test;
+	const std::string * tests_begin;
+	const std::string * tests_end;
 	const char * expr;
 	
 	enum token_type {
@@ -56,8 +74,8 @@ struct evaluator {
 	const char * token_start;
 	size_t token_length;
 	
-	evaluator(const std::string & expression, const std::string & variable)
-		: test(variable), expr(expression.c_str()), token(end) { }
+	evaluator(const std::string & expression, const std::string * first, const std::string * last)
+		: tests_begin(first), tests_end(last), expr(expression.c_str()), token(end) { }
 	
 	token_type next() {
 		
@@ -100,7 +118,10 @@ struct evaluator {
 	}
 	
 	bool eval_identifier(bool lazy) {
-		bool result = lazy || test.compare(0, std::string::npos, token_start, token_length) == 0;
+		bool result = lazy;
+		for(const std::string * test = tests_begin; !result && test != tests_end; ++test) {
+			result = identifier_equals(*test, token_start, token_length);
+		}
 		next();
 		return result;
 	}
@@ -161,7 +182,17 @@ struct evaluator {
 
 bool expression_match(const std::string & test, const std::string & expression) {
 	try {
-		return evaluator(expression, test).eval();
+		return evaluator(expression, &test, &test + 1).eval();
+	} catch(const std::runtime_error & error) {
+		log_warning << "Error evaluating \"" << expression << "\": " << error.what();
+		return true;
+	}
+}
+
+bool expression_match(const std::vector<std::string> & tests, const std::string & expression) {
+	try {
+		const std::string * begin = tests.empty() ? NULL : &tests[0];
+		return evaluator(expression, begin, begin + tests.size()).eval();
 	} catch(const std::runtime_error & error) {
 		log_warning << "Error evaluating \"" << expression << "\": " << error.what();
 		return true;
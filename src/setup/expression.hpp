@@ -27,14 +27,24 @@
 #define INNOEXTRACT_SETUP_EXPRESSION_HPP
 
 #include <string>
+#include <vector>
 
 namespace setup {
 
 /*
  * Determine if the given expression is satisfied with (only) the given test variable set to true
+ *
+ * Names are compared case-insensitively.
  */
 bool expression_match(const std::string & test, const std::string & expression);
 
+/*
+ * Determine if the given expression is satisfied with (only) the given test variables set to true
+ *
+ * Names are compared case-insensitively.
+ */
+bool expression_match(const std::vector<std::string> & tests, const std::string & expression);
+
 bool is_simple_expression(const std::string & expression);
 
 } // namespace setup
@@ -25,6 +25,8 @@
 #include <sstream>
 
 #include <boost/foreach.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/array.hpp>
 
 #include "crypto/hasher.hpp"
 #include "crypto/pbkdf2.hpp"
@@ -135,31 +137,90 @@ void load_wizard_and_decompressor(std::istream & is, const setup::version & vers
 	
 }
 
-void check_is_end(stream::block_reader::pointer & is, const char * what) {
-	is->exceptions(std::ios_base::goodbit);
+void check_is_end(std::istream & is, const char * what) {
+	is.exceptions(std::ios_base::goodbit);
 	char dummy;
-	if(!is->get(dummy).eof()) {
+	if(!is.get(dummy).eof()) {
 		throw std::ios_base::failure(what);
 	}
 }
 
+void read_block(std::istream & is, std::string & result) {
+	
+	result.clear();
+	
+	is.exceptions(std::ios_base::badbit);
+	char buffer[8192];
+	while(!is.eof()) {
+		is.read(buffer, std::streamsize(sizeof(buffer)));
+		result.append(buffer, size_t(is.gcount()));
+	}
+	
+}
+
+typedef boost::iostreams::stream<boost::iostreams::array_source> block_stream;
+
 } // anonymous namespace
 
-void info::try_load(std::istream & is, entry_types entries, util::codepage_id force_codepage) {
+void info::try_load(std::istream & is, entry_types entries, util::codepage_id force_codepage,
+                    header_blocks * blocks) {
 	
 	debug("trying to load setup headers for version " << version);
 	
+	stream::block_reader::pointer reader = stream::block_reader::get(is, version);
+	
+	if(blocks) {
+		
+		// Keep the decompressed headers
+		read_block(*reader, blocks->primary);
+		block_stream primary(blocks->primary.data(), blocks->primary.size());
+		primary.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		load_primary(primary, entries, force_codepage);
+		
+		reader = stream::block_reader::get(is, version);
+		read_block(*reader, blocks->secondary);
+		block_stream secondary(blocks->secondary.data(), blocks->secondary.size());
+		secondary.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		load_secondary(secondary, entries);
+		
+	} else {
+		
+		load_primary(*reader, entries, force_codepage);
+		
+		// restart the compression stream
+		reader = stream::block_reader::get(is, version);
+		
+		load_secondary(*reader, entries);
+		
+	}
+	
+}
+
+void info::load(const setup::version & setup_version, std::istream & primary, std::istream & secondary,
+                entry_types entries, util::codepage_id force_codepage) {
+	
+	version = setup_version;
+	
+	if(version.is_ambiguous()) {
+		entries |= NoSkip;
+	}
+	
+	load_primary(primary, entries, force_codepage);
+	load_secondary(secondary, entries);
+	
+}
+
+void info::load_primary(std::istream & is, entry_types entries, util::codepage_id force_codepage) {
+	
 	if((entries & (Messages | NoSkip)) || (!version.is_unicode() && !force_codepage)) {
 		entries |= Languages;
 	}
 	
-	stream::block_reader::pointer reader = stream::block_reader::get(is, version);
-	
 	debug("loading main header");
-	header.load(*reader, version);
+	header.load(is, version);
 	
 	debug("loading languages");
-	load_entries(*reader, entries, header.language_count, languages, Languages);
+	load_entries(is, entries, header.language_count, languages, Languages);
 	
 	debug("determining encoding");
 	if(version.is_unicode()) {
@@ -189,56 +250,58 @@ void info::try_load(std::istream & is, entry_types entries, util::codepage_id fo
 	
 	if(version < INNO_VERSION(4, 0, 0)) {
 		debug("loading images and plugins");
-		load_wizard_and_decompressor(*reader, version, header, *this, entries);
+		load_wizard_and_decompressor(is, version, header, *this, entries);
 	}
 	
 	debug("loading messages");
-	load_entries(*reader, entries, header.message_count, messages, Messages);
+	load_entries(is, entries, header.message_count, messages, Messages);
 	debug("loading permissions");
-	load_entries(*reader, entries, header.permission_count, permissions, Permissions);
+	load_entries(is, entries, header.permission_count, permissions, Permissions);
 	debug("loading types");
-	load_entries(*reader, entries, header.type_count, types, Types);
+	load_entries(is, entries, header.type_count, types, Types);
 	debug("loading components");
-	load_entries(*reader, entries, header.component_count, components, Components);
+	load_entries(is, entries, header.component_count, components, Components);
 	debug("loading tasks");
-	load_entries(*reader, entries, header.task_count, tasks, Tasks);
+	load_entries(is, entries, header.task_count, tasks, Tasks);
 	debug("loading directories");
-	load_entries(*reader, entries, header.directory_count, directories, Directories);
+	load_entries(is, entries, header.directory_count, directories, Directories);
 	debug("loading files");
-	load_entries(*reader, entries, header.file_count, files, Files);
+	load_entries(is, entries, header.file_count, files, Files);
 	debug("loading icons");
-	load_entries(*reader, entries, header.icon_count, icons, Icons);
+	load_entries(is, entries, header.icon_count, icons, Icons);
 	debug("loading ini entries");
-	load_entries(*reader, entries, header.ini_entry_count, ini_entries, IniEntries);
+	load_entries(is, entries, header.ini_entry_count, ini_entries, IniEntries);
 	debug("loading registry entries");
-	load_entries(*reader, entries, header.registry_entry_count, registry_entries, RegistryEntries);
+	load_entries(is, entries, header.registry_entry_count, registry_entries, RegistryEntries);
 	debug("loading delete entries");
-	load_entries(*reader, entries, header.delete_entry_count, delete_entries, DeleteEntries);
+	load_entries(is, entries, header.delete_entry_count, delete_entries, DeleteEntries);
 	debug("loading uninstall delete entries");
-	load_entries(*reader, entries, header.uninstall_delete_entry_count, uninstall_delete_entries,
+	load_entries(is, entries, header.uninstall_delete_entry_count, uninstall_delete_entries,
 	             UninstallDeleteEntries);
 	debug("loading run entries");
-	load_entries(*reader, entries, header.run_entry_count, run_entries, RunEntries);
+	load_entries(is, entries, header.run_entry_count, run_entries, RunEntries);
 	debug("loading uninstall run entries");
-	load_entries(*reader, entries, header.uninstall_run_entry_count, uninstall_run_entries,
+	load_entries(is, entries, header.uninstall_run_entry_count, uninstall_run_entries,
 	             UninstallRunEntries);
 	
 	if(version >= INNO_VERSION(4, 0, 0)) {
 		debug("loading images and plugins");
-		load_wizard_and_decompressor(*reader, version, header, *this, entries);
+		load_wizard_and_decompressor(is, version, header, *this, entries);
 	}
 	
-	// restart the compression stream
-	check_is_end(reader, "unknown data at end of primary header stream");
-	reader = stream::block_reader::get(is, version);
+	check_is_end(is, "unknown data at end of primary header stream");
+}
+
+void info::load_secondary(std::istream & is, entry_types entries) {
 	
 	debug("loading data entries");
-	load_entries(*reader, entries, header.data_entry_count, data_entries, DataEntries);
+	load_entries(is, entries, header.data_entry_count, data_entries, DataEntries);
 	
-	check_is_end(reader, "unknown data at end of secondary header stream");
+	check_is_end(is, "unknown data at end of secondary header stream");
 }
 
-void info::load(std::istream & is, entry_types entries, util::codepage_id force_codepage) {
+void info::load(std::istream & is, entry_types entries, util::codepage_id force_codepage,
+                header_blocks * blocks) {
 	
 	version.load(is);
 	
@@ -272,7 +335,7 @@ void info::load(std::istream & is, entry_types entries, util::codepage_id force_
 		try {
 			
 			// Try to parse headers for this version
-			try_load(is, entries, force_codepage);
+			try_load(is, entries, force_codepage, blocks);
 			
 			if(warnings) {
 				// Parsed without errors but with warnings - try other versions first
@@ -298,7 +361,7 @@ void info::load(std::istream & is, entry_types entries, util::codepage_id force_
 					// Rewind to a previous version that had better results and report those
 					version.value = listed_version;
 					warnings.restore();
-					try_load(is, entries, force_codepage);
+					try_load(is, entries, force_codepage, blocks);
 				} else {
 					// Otherwise. report results for the current version
 					warnings.flush();
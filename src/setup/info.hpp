@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <iosfwd>
+#include <string>
 
 #include "setup/header.hpp"
 #include "setup/version.hpp"
@@ -120,6 +121,14 @@ struct info {
 	//! Loading enabled by \c DecryptDll
 	std::string decrypt_dll;
 	
+	//! Decompressed contents of the two setup header block streams.
+	struct header_blocks {
+		
+		std::string primary;   //!< Main setup header and all entries except data entries
+		std::string secondary; //!< Data entries
+		
+	};
+	
 	/*!
 	 * Load setup headers.
 	 *
@@ -129,8 +138,23 @@ struct info {
 	 *                \ref loader::offsets::header_offset.
 	 * \param entries What kinds of entries to load.
 	 * \param force_codepage Windows codepage to use for strings in ANSI installers.
+	 * \param blocks  If not \c NULL, receives the decompressed header blocks so that they can
+	 *                be loaded again later without decompressing them.
+	 */
+	void load(std::istream & is, entry_types entries, util::codepage_id force_codepage = 0,
+	          header_blocks * blocks = NULL);
+	
+	/*!
+	 * Load setup headers from decompressed header blocks.
+	 *
+	 * \param setup_version  The setup data version determined by a previous call to \ref load.
+	 * \param primary        Stream containing \ref header_blocks::primary.
+	 * \param secondary      Stream containing \ref header_blocks::secondary.
+	 * \param entries        What kinds of entries to load.
+	 * \param force_codepage Windows codepage to use for strings in ANSI installers.
 	 */
-	void load(std::istream & is, entry_types entries, util::codepage_id force_codepage = 0);
+	void load(const setup::version & setup_version, std::istream & primary, std::istream & secondary,
+	          entry_types entries, util::codepage_id force_codepage = 0);
 	
 	std::string get_key(const std::string & password);
 	
@@ -148,10 +172,18 @@ private:
 	 *                \ref loader::offsets::header_offset.
 	 * \param entries What kinds of entries to load.
 	 * \param force_codepage Windows codepage to use for strings in ANSI installers.
+	 * \param blocks  If not \c NULL, receives the decompressed header blocks.
 	 *
 	 * This function does not set the \ref version member.
 	 */
-	void try_load(std::istream & is, entry_types entries, util::codepage_id force_codepage);
+	void try_load(std::istream & is, entry_types entries, util::codepage_id force_codepage,
+	              header_blocks * blocks);
+	
+	//! Load the main setup header and entries from the decompressed primary block stream.
+	void load_primary(std::istream & is, entry_types entries, util::codepage_id force_codepage);
+	
+	//! Load data entries from the decompressed secondary block stream.
+	void load_secondary(std::istream & is, entry_types entries);
 	
 	template <class Entry>
 	void load_entries(std::istream & is, entry_types entries, size_t count,
@@ -34,10 +34,10 @@
 #include <boost/iostreams/read.hpp>
 #include <boost/make_shared.hpp>
 
-#include "release.hpp"
 #include "crypto/crc32.hpp"
 #include "setup/version.hpp"
 #include "stream/lzma.hpp"
+#include "stream/lzmadec.hpp"
 #include "util/endian.hpp"
 #include "util/enum.hpp"
 #include "util/load.hpp"
@@ -150,16 +150,17 @@ NAMES(stream::block_compression, "Compression",
 
 namespace stream {
 
-block_reader::pointer block_reader::get(std::istream & base, const setup::version & version) {
-	
-	USE_ENUM_NAMES(block_compression)
+namespace {
+
+//! Read a block stream header and return the size of the stored data.
+boost::uint32_t load_block_header(std::istream & base, const setup::version & version,
+                                  block_compression & compression) {
 	
 	boost::uint32_t expected_checksum = util::load<boost::uint32_t>(base);
 	crypto::crc32 actual_checksum;
 	actual_checksum.init();
 	
 	boost::uint32_t stored_size;
-	block_compression compression;
 	
 	if(version >= INNO_VERSION(4, 0, 9)) {
 		
@@ -187,6 +188,18 @@ block_reader::pointer block_reader::get(std::istream & base, const setup::versio
 		throw block_error("block header CRC32 mismatch");
 	}
 	
+	return stored_size;
+}
+
+} // anonymous namespace
+
+block_reader::pointer block_reader::get(std::istream & base, const setup::version & version) {
+	
+	USE_ENUM_NAMES(block_compression)
+	
+	block_compression compression;
+	boost::uint32_t stored_size = load_block_header(base, version, compression);
+	
 	debug("[block] size: " << stored_size << "  compression: " << compression);
 	
 	util::unique_ptr<io::filtering_istream>::type fis(new io::filtering_istream);
@@ -197,8 +210,10 @@ block_reader::pointer block_reader::get(std::istream & base, const setup::versio
 	#if INNOEXTRACT_HAVE_LZMA
 		case LZMA1: fis->push(inno_lzma1_decompressor(), 8192); break;
 	#else
-		case LZMA1: throw block_error("LZMA decompression not supported by this "
-			                  + std::string(innoextract_name) + " build");
+		case LZMA1: {
+			fis->push(inno_lzma_builtin_decompressor(inno_lzma_decoder::LZMA1Stream, 0, 8192), 8192);
+			break;
+		}
 	#endif
 	}
 	
@@ -211,4 +226,15 @@ block_reader::pointer block_reader::get(std::istream & base, const setup::versio
 	return pointer(fis.release());
 }
 
+void block_reader::skip(std::istream & base, const setup::version & version) {
+	
+	block_compression compression;
+	boost::uint32_t stored_size = load_block_header(base, version, compression);
+	
+	if(base.seekg(std::streamoff(stored_size), std::ios_base::cur).fail()) {
+		throw block_error("could not skip block");
+	}
+	
+}
+
 } // namespace stream
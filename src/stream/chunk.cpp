@@ -30,15 +30,17 @@
 #include <boost/make_shared.hpp>
 #include <boost/range/size.hpp>
 
-#include "release.hpp"
 #include "crypto/arc4.hpp"
 #include "crypto/checksum.hpp"
 #include "crypto/hasher.hpp"
 #include "crypto/xchacha20.hpp"
 #include "stream/lzma.hpp"
+#include "stream/lzmadec.hpp"
 #include "stream/restrict.hpp"
+#include "stream/seekindex.hpp"
 #include "stream/slice.hpp"
 #include "util/endian.hpp"
+#include "util/fstream.hpp"
 #include "util/log.hpp"
 
 
@@ -50,6 +52,12 @@ namespace {
 
 const char chunk_id[4] = { 'z', 'l', 'b', 0x1a };
 
+//! Size of reads from the slice files - each read is a separate system call.
+const std::streamsize slice_buffer_size = 64 * 1024;
+
+//! Size of the input and output buffers for the built-in LZMA decoder.
+const std::streamsize lzma_buffer_size = 64 * 1024;
+
 #if INNOEXTRACT_HAVE_DECRYPTION
 
 /*!
@@ -129,6 +137,19 @@ private:
 
 #endif // INNOEXTRACT_HAVE_DECRYPTION
 
+void seek_to_chunk(slice_reader & base, const chunk & chunk) {
+	
+	if(!base.seek(chunk.first_slice, chunk.offset)) {
+		throw chunk_error("could not seek to chunk start");
+	}
+	
+	char magic[sizeof(chunk_id)];
+	if(base.read(magic, 4) != 4 || std::memcmp(magic, chunk_id, sizeof(chunk_id)) != 0) {
+		throw chunk_error("bad chunk magic");
+	}
+	
+}
+
 } // anonymous namespace
 
 bool chunk::operator<(const chunk & o) const {
@@ -157,31 +178,87 @@ bool chunk::operator==(const chunk & o) const {
 }
 
 chunk_reader::pointer chunk_reader::get(slice_reader & base, const chunk & chunk , const std::string & key) {
+	boost::uint64_t position = 0;
+	return get(base, chunk, key, NULL, position, 0);
+}
+
+chunk_reader::pointer chunk_reader::get(slice_reader & base, const chunk & chunk, const std::string & key,
+                                        seek_index * index, boost::uint64_t & position,
+                                        boost::uint64_t size) {
 	
-	if(!base.seek(chunk.first_slice, chunk.offset)) {
-		throw chunk_error("could not seek to chunk start");
-	}
-	
-	char magic[sizeof(chunk_id)];
-	if(base.read(magic, 4) != 4 || std::memcmp(magic, chunk_id, sizeof(chunk_id)) != 0) {
-		throw chunk_error("bad chunk magic");
-	}
+	seek_to_chunk(base, chunk);
 	
 	pointer result(new boost::iostreams::chain<boost::iostreams::input>);
 	
-	switch(chunk.compression) {
-		case Stored: break;
-		case Zlib:   result->push(io::zlib_decompressor(), 8192); break;
-		case BZip2:  result->push(io::bzip2_decompressor(), 8192); break;
-	#if INNOEXTRACT_HAVE_LZMA
-		case LZMA1:  result->push(inno_lzma1_decompressor(), 8192); break;
-		case LZMA2:  result->push(inno_lzma2_decompressor(), 8192); break;
-	#else
-		case LZMA1: case LZMA2:
-			throw chunk_error("LZMA decompression not supported by this "
-			                  + std::string(innoextract_name) + " build");
-	#endif
-		default: throw chunk_error("unknown chunk compression");
+	boost::uint64_t skipped = 0; // Compressed bytes skipped using a checkpoint
+	
+	if(index && chunk.encryption == Plaintext
+	   && (chunk.compression == LZMA1 || chunk.compression == LZMA2)) {
+		
+		inno_lzma_decoder::stream_format format = inno_lzma_decoder::LZMA2Stream;
+		if(chunk.compression == LZMA1) {
+			format = inno_lzma_decoder::LZMA1Stream;
+		}
+		
+		seek_index::checkpoint checkpoint;
+		util::ifstream state;
+		if(position != 0 && index->find(chunk, position, checkpoint)
+		   && checkpoint.input < chunk.size && index->open(checkpoint, state)) {
+			size_t slice = chunk.first_slice;
+			boost::uint32_t offset = chunk.offset;
+			if(base.locate(slice, offset, sizeof(chunk_id) + checkpoint.input, NULL)
+			   && base.seek(slice, offset)) {
+				try {
+					inno_lzma_checkpoint_decompressor decompressor(format, index->recorder(chunk), &state,
+					                                               lzma_buffer_size);
+					decompressor.filter().reserve_dictionary(size);
+					result->push(decompressor, lzma_buffer_size);
+					skipped = checkpoint.input;
+				} catch(const lzma_error & e) {
+					log_warning << "Could not load checkpoint from seek index: " << e.what();
+				}
+			}
+			if(!skipped) {
+				seek_to_chunk(base, chunk);
+			}
+		}
+		
+		if(skipped) {
+			position = checkpoint.output;
+		} else {
+			inno_lzma_checkpoint_decompressor decompressor(format, index->recorder(chunk), NULL,
+			                                               lzma_buffer_size);
+			decompressor.filter().reserve_dictionary(size);
+			result->push(decompressor, lzma_buffer_size);
+			position = 0;
+		}
+		
+	} else {
+		
+		position = 0;
+		
+		switch(chunk.compression) {
+			case Stored: break;
+			case Zlib:   result->push(io::zlib_decompressor(), 8192); break;
+			case BZip2:  result->push(io::bzip2_decompressor(), 8192); break;
+		#if INNOEXTRACT_HAVE_LZMA
+			case LZMA1:  result->push(inno_lzma1_decompressor(), 8192); break;
+			case LZMA2:  result->push(inno_lzma2_decompressor(), 8192); break;
+		#else
+			case LZMA1: {
+				result->push(inno_lzma_builtin_decompressor(inno_lzma_decoder::LZMA1Stream, size,
+				                                            lzma_buffer_size), lzma_buffer_size);
+				break;
+			}
+			case LZMA2: {
+				result->push(inno_lzma_builtin_decompressor(inno_lzma_decoder::LZMA2Stream, size,
+				                                            lzma_buffer_size), lzma_buffer_size);
+				break;
+			}
+		#endif
+			default: throw chunk_error("unknown chunk compression");
+		}
+		
 	}
 	
 	switch(chunk.encryption) {
@@ -218,11 +295,32 @@ chunk_reader::pointer chunk_reader::get(slice_reader & base, const chunk & chunk
 		#endif
 	}
 	
-	result->push(restrict(base, chunk.size));
+	result->push(restrict(base, chunk.size - skipped), slice_buffer_size);
 	
 	return result;
 }
 
+boost::uint32_t chunk_reader::dictionary_size(slice_reader & base, const chunk & chunk) {
+	
+	if((chunk.compression != LZMA1 && chunk.compression != LZMA2) || chunk.encryption != Plaintext) {
+		return 0;
+	}
+	
+	seek_to_chunk(base, chunk);
+	
+	char header[5];
+	std::streamsize length = (chunk.compression == LZMA1) ? 5 : 1;
+	if(base.read(header, length) != length) {
+		throw chunk_error("could not read LZMA header");
+	}
+	
+	if(chunk.compression == LZMA1) {
+		return util::little_endian::load<boost::uint32_t>(header + 1);
+	}
+	
+	return lzma2_dictionary_size(boost::uint8_t(header[0]));
+}
+
 } // namespace stream
 
 NAMES(stream::compression_method, "Compression Method",
@@ -42,6 +42,7 @@
 
 namespace stream {
 
+class seek_index;
 class slice_reader;
 
 //! Error thrown by \ref chunk_reader::get if there was a problem.
@@ -123,6 +124,45 @@ public:
 	 */
 	static pointer get(slice_reader & base, const ::stream::chunk & chunk, const std::string & key);
 	
+	/*!
+	 * Wrap a \ref slice_reader to read and decompress a single chunk, starting at a
+	 * checkpoint from a seek index if possible.
+	 *
+	 * LZMA chunks read through this function are decoded using \ref inno_lzma_decoder and
+	 * new checkpoints are recorded in the index.
+	 *
+	 * \param base     The slice reader for the setup file(s).
+	 * \param chunk    Information specifying the chunk to read.
+	 * \param key      Key used for encrypted chunks.
+	 * \param index    Seek index to load and record checkpoints or \c NULL.
+	 * \param position Position in the decompressed chunk data that should be read next.
+	 *                 Updated to the position at which the returned stream starts, which
+	 *                 is never after the requested position.
+	 * \param size     Number of decompressed bytes that will be read from the chunk or \c 0
+	 *                 if not known. Used to size the dictionary of the built-in LZMA decoder.
+	 *
+	 * \throws chunk_error if the chunk header could not be read or was invalid,
+	 *                     or if the chunk compression is not supported by this build.
+	 *
+	 * \return a pointer to a non-seekable input filter chain for the requested file.
+	 */
+	static pointer get(slice_reader & base, const ::stream::chunk & chunk, const std::string & key,
+	                   seek_index * index, boost::uint64_t & position, boost::uint64_t size);
+	
+	/*!
+	 * Read the LZMA dictionary size from the header of a chunk without decompressing it.
+	 *
+	 * \param base  The slice reader for the setup file(s).
+	 * \param chunk Information specifying the chunk to read.
+	 *
+	 * \throws chunk_error if the chunk header could not be read.
+	 * \throws lzma_error if the chunk header was invalid.
+	 *
+	 * \return the dictionary size or \c 0 if the chunk is not compressed using LZMA or if
+	 *         the stream header is encrypted.
+	 */
+	static boost::uint32_t dictionary_size(slice_reader & base, const ::stream::chunk & chunk);
+	
 };
 
 } // namespace stream
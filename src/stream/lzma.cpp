@@ -128,16 +128,7 @@ bool inno_lzma2_decompressor_impl::filter(const char * & begin_in, const char *
 		
 		lzma_options_lzma options;
 		
-		boost::uint8_t prop = boost::uint8_t(*begin_in++);
-		if(prop > 40) {
-			throw lzma_error("inno lzma2 property error", LZMA_FORMAT_ERROR);
-		}
-		
-		if(prop == 40) {
-			options.dict_size = 0xffffffff;
-		} else {
-			options.dict_size = ((boost::uint32_t(2) | boost::uint32_t((prop) & 1)) << ((prop) / 2 + 11));
-		}
+		options.dict_size = lzma2_dictionary_size(boost::uint8_t(*begin_in++));
 		
 		stream = init_raw_lzma_stream(LZMA_FILTER_LZMA2, options);
 	}
@@ -26,15 +26,13 @@
 #ifndef INNOEXTRACT_STREAM_LZMA_HPP
 #define INNOEXTRACT_STREAM_LZMA_HPP
 
-#include "configure.hpp"
-
-#if INNOEXTRACT_HAVE_LZMA
-
 #include <stddef.h>
-#include <iosfwd>
+#include <ios>
+#include <string>
 
-#include <boost/iostreams/filter/symmetric.hpp>
-#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+
+#include "configure.hpp"
 
 namespace stream {
 
@@ -44,7 +42,7 @@ struct lzma_error : public std::ios_base::failure {
 	lzma_error(const std::string & msg, int code)
 		: std::ios_base::failure(msg), error_code(code) { }
 	
-	//! \return the liblzma code for the error.
+	//! \return the liblzma code for the error or \c 0 if it was not reported by liblzma.
 	int error() const { return error_code; }
 	
 private:
@@ -52,6 +50,31 @@ private:
 	int error_code;
 };
 
+/*!
+ * Decode the dictionary size from the property byte at the start of Inno Setup LZMA2 data.
+ *
+ * \throws lzma_error if the property byte is invalid.
+ */
+inline boost::uint32_t lzma2_dictionary_size(boost::uint8_t prop) {
+	
+	if(prop > 40) {
+		throw lzma_error("inno lzma2 property error", 0);
+	} else if(prop == 40) {
+		return 0xffffffff;
+	}
+	
+	return (boost::uint32_t(2) | boost::uint32_t(prop & 1)) << (prop / 2 + 11);
+}
+
+} // namespace stream
+
+#if INNOEXTRACT_HAVE_LZMA
+
+#include <boost/iostreams/filter/symmetric.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace stream {
+
 class lzma_decompressor_impl_base : private boost::noncopyable {
 	
 public:
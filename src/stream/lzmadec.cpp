@@ -0,0 +1,845 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "stream/lzmadec.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+#include "stream/lzma.hpp"
+#include "util/endian.hpp"
+#include "util/load.hpp"
+
+namespace stream {
+
+namespace {
+
+const boost::uint32_t top_value = boost::uint32_t(1) << 24;
+const unsigned probability_bits = 11;
+const unsigned probability_move_bits = 5;
+const boost::uint16_t probability_init = (1 << probability_bits) / 2;
+
+const unsigned states = 12;
+const unsigned max_pos_bits = 4;
+const unsigned pos_slot_bits = 6;
+const unsigned length_to_pos_states = 4;
+const unsigned align_bits = 4;
+const unsigned end_pos_model_index = 14;
+const unsigned full_distances = 1 << (end_pos_model_index / 2);
+const unsigned match_min_length = 2;
+const size_t match_max_length = 273;
+
+const unsigned length_low_bits = 3;
+const unsigned length_mid_bits = 3;
+const unsigned length_high_bits = 8;
+
+// Layout of the length decoder probabilities
+const size_t length_choice = 0;
+const size_t length_choice2 = 1;
+const size_t length_low = 2;
+const size_t length_mid = length_low + (size_t(1) << (max_pos_bits + length_low_bits));
+const size_t length_high = length_mid + (size_t(1) << (max_pos_bits + length_mid_bits));
+const size_t length_probabilities = length_high + (size_t(1) << length_high_bits);
+
+// Layout of the decoder probabilities
+const size_t is_match = 0;
+const size_t is_rep = is_match + (states << max_pos_bits);
+const size_t is_rep_g0 = is_rep + states;
+const size_t is_rep_g1 = is_rep_g0 + states;
+const size_t is_rep_g2 = is_rep_g1 + states;
+const size_t is_rep0_long = is_rep_g2 + states;
+const size_t pos_slot = is_rep0_long + (states << max_pos_bits);
+const size_t pos_special = pos_slot + (length_to_pos_states << pos_slot_bits);
+const size_t align = pos_special + full_distances - end_pos_model_index + 1;
+const size_t length_coder = align + (1 << align_bits);
+const size_t rep_length_coder = length_coder + length_probabilities;
+const size_t literal = rep_length_coder + length_probabilities;
+const size_t literal_coder_size = 0x300;
+
+/*!
+ * Maximum number of compressed bytes needed to decode one symbol or LZMA2 chunk header,
+ * including range decoder initialization.
+ */
+const size_t max_symbol_input = 21;
+
+//! Maximum number of bytes decoded before returning data to the caller.
+const size_t max_step_output = 64 * 1024;
+
+const size_t input_buffer_size = 64 * 1024;
+
+//! Version of the format written by \ref inno_lzma_decoder::save.
+const boost::uint8_t state_version = 2;
+
+template <class T>
+void store(std::ostream & os, T value) {
+	char buffer[sizeof(T)];
+	util::little_endian::store(value, buffer);
+	os.write(buffer, std::streamsize(sizeof(buffer)));
+}
+
+/*!
+ * Range decoder state for decoding a run of symbols.
+ *
+ * Kept in a local variable so that the compiler does not need to reload it after every
+ * write to the dictionary.
+ */
+struct range_decoder {
+	
+	boost::uint32_t range;
+	boost::uint32_t code;
+	const boost::uint8_t * next;
+	
+	void normalize() {
+		if(range < top_value) {
+			range <<= 8;
+			code = (code << 8) | *next++;
+		}
+	}
+	
+	//! Decode a bit that selects the next step of the decoder.
+	unsigned decode_bit(boost::uint16_t & prob) {
+		
+		boost::uint32_t bound = (range >> probability_bits) * prob;
+		
+		unsigned bit;
+		if(code < bound) {
+			range = bound;
+			prob = boost::uint16_t(prob + (((1 << probability_bits) - prob) >> probability_move_bits));
+			bit = 0;
+		} else {
+			range -= bound;
+			code -= bound;
+			prob = boost::uint16_t(prob - (prob >> probability_move_bits));
+			bit = 1;
+		}
+		normalize();
+		
+		return bit;
+	}
+	
+	/*!
+	 * Decode a bit that is only used as part of a larger value.
+	 *
+	 * Written without branches on the bit value as these bits are hard to predict.
+	 */
+	unsigned decode_value_bit(boost::uint16_t & prob) {
+		
+		boost::uint32_t bound = (range >> probability_bits) * prob;
+		
+		unsigned bit = (code >= bound);
+		boost::uint32_t mask = 0 - boost::uint32_t(bit);
+		range = bound + ((range - bound - bound) & mask);
+		code -= bound & mask;
+		unsigned delta = ((((1 << probability_bits) - prob) & ~mask) | (prob & mask)) >> probability_move_bits;
+		prob = boost::uint16_t(prob + ((delta ^ mask) - mask));
+		normalize();
+		
+		return bit;
+	}
+	
+	boost::uint32_t decode_direct_bits(unsigned count) {
+		
+		boost::uint32_t result = 0;
+		
+		do {
+			range >>= 1;
+			code -= range;
+			boost::uint32_t mask = 0 - (code >> 31);
+			code += range & mask;
+			normalize();
+			result = (result << 1) + (mask + 1);
+		} while(--count);
+		
+		return result;
+	}
+	
+	boost::uint32_t decode_tree(boost::uint16_t * tree, unsigned bits) {
+		
+		boost::uint32_t m = 1;
+		for(unsigned i = 0; i < bits; i++) {
+			m = (m << 1) + decode_value_bit(tree[m]);
+		}
+		
+		return m - (boost::uint32_t(1) << bits);
+	}
+	
+	boost::uint32_t decode_reverse_tree(boost::uint16_t * tree, unsigned bits) {
+		
+		boost::uint32_t m = 1;
+		boost::uint32_t symbol = 0;
+		for(unsigned i = 0; i < bits; i++) {
+			unsigned bit = decode_value_bit(tree[m]);
+			m = (m << 1) + bit;
+			symbol |= boost::uint32_t(bit) << i;
+		}
+		
+		return symbol;
+	}
+	
+	boost::uint32_t decode_length(boost::uint16_t * p, unsigned pos_state) {
+		
+		if(!decode_bit(p[length_choice])) {
+			return decode_tree(p + length_low + (pos_state << length_low_bits), length_low_bits);
+		}
+		
+		if(!decode_bit(p[length_choice2])) {
+			return (1 << length_low_bits)
+			       + decode_tree(p + length_mid + (pos_state << length_mid_bits), length_mid_bits);
+		}
+		
+		return (1 << length_low_bits) + (1 << length_mid_bits)
+		       + decode_tree(p + length_high, length_high_bits);
+	}
+	
+	//! Decode a literal using the byte at the last match distance as context.
+	unsigned decode_matched_literal(boost::uint16_t * p, unsigned match_byte) {
+		
+		unsigned symbol = 1;
+		unsigned offset = 0x100; // 0x100 while the decoded bits are equal to the match byte
+		
+		do {
+			match_byte <<= 1;
+			unsigned matching = offset;
+			offset &= match_byte;
+			unsigned bit = decode_value_bit(p[offset + matching + symbol]);
+			symbol = (symbol << 1) | bit;
+			offset ^= matching & (bit - 1);
+		} while(symbol < 0x100);
+		
+		return symbol;
+	}
+	
+};
+
+} // anonymous namespace
+
+inno_lzma_decoder::inno_lzma_decoder(stream_format stream_type,
+                                     const boost::shared_ptr<lzma_checkpoint_sink> & checkpoint_sink,
+                                     std::istream * saved_state)
+	: format(stream_type), stage(StreamHeader), sink(checkpoint_sink), next_checkpoint(0)
+	, in_pos(0), in_end(0), input_base(0)
+	, lc(0), lp(0), pb(0), dict_size(0), need_dictionary_reset(true), need_properties(true)
+	, chunk_unpacked(0), chunk_packed(0), range(0), code(0)
+	, state(0), rep0(0), rep1(0), rep2(0), rep3(0)
+	, window_size(0), window_pos(0), allocation(0), history(0), pending(0), output(0) {
+	if(saved_state) {
+		load(*saved_state);
+	}
+}
+
+void inno_lzma_decoder::close() {
+	std::vector<boost::uint8_t>().swap(input);
+	std::vector<boost::uint16_t>().swap(probs);
+	std::vector<boost::uint8_t>().swap(window);
+	sink.reset();
+}
+
+bool inno_lzma_decoder::filter(const char * & begin_in, const char * end_in,
+                               char * & begin_out, char * end_out, bool flush) {
+	
+	bool last = fill(begin_in, end_in) && flush;
+	
+	while(true) {
+		
+		flush_output(begin_out, end_out);
+		if(pending != 0) {
+			return true;
+		}
+		
+		if(stage == StreamEnd) {
+			return false;
+		}
+		
+		if(sink && output >= next_checkpoint && stage != StreamHeader) {
+			next_checkpoint = sink->checkpoint(*this);
+		}
+		
+		if(begin_out == end_out) {
+			return true;
+		}
+		
+		if(in_end - in_pos < max_symbol_input && !last) {
+			last = fill(begin_in, end_in) && flush;
+			if(in_end - in_pos < max_symbol_input && !last) {
+				return true;
+			}
+		}
+		
+		if(in_pos == in_end && last) {
+			throw lzma_error("truncated lzma stream", 0);
+		}
+		
+		size_t limit = std::min(size_t(end_out - begin_out), max_step_output);
+		
+		switch(stage) {
+			case StreamHeader: decode_header(); break;
+			case LZMA1Data: {
+				if(decode_symbols(limit)) {
+					stage = StreamEnd;
+				}
+				break;
+			}
+			case LZMA2Control: decode_control(); break;
+			case LZMA2Compressed: decode_chunk(limit); break;
+			case LZMA2Uncompressed: copy_uncompressed(limit); break;
+			case StreamEnd: break;
+		}
+		
+		if(in_pos > in_end) {
+			throw lzma_error("truncated lzma stream", 0);
+		}
+		
+	}
+}
+
+bool inno_lzma_decoder::fill(const char * & begin_in, const char * end_in) {
+	
+	if(input.empty()) {
+		// Reading past the end of the available data returns zero bytes from the padding
+		input.resize(input_buffer_size + max_symbol_input);
+	}
+	
+	if(in_pos != 0 && in_end - in_pos < max_symbol_input) {
+		std::memmove(&input[0], &input[0] + in_pos, in_end - in_pos);
+		input_base += boost::uint64_t(in_pos);
+		in_end -= in_pos, in_pos = 0;
+	}
+	
+	size_t n = std::min(size_t(end_in - begin_in), input_buffer_size - in_end);
+	std::memcpy(&input[0] + in_end, begin_in, n);
+	in_end += n, begin_in += n;
+	std::memset(&input[0] + in_end, 0, max_symbol_input);
+	
+	return begin_in == end_in;
+}
+
+void inno_lzma_decoder::flush_output(char * & begin_out, char * end_out) {
+	
+	while(pending != 0 && begin_out != end_out) {
+		size_t start = window_pos >= pending ? window_pos - pending : window_pos + window.size() - pending;
+		size_t n = std::min(pending, std::min(window.size() - start, size_t(end_out - begin_out)));
+		std::memcpy(begin_out, &window[start], n);
+		begin_out += n, pending -= n, output += n;
+	}
+	
+}
+
+void inno_lzma_decoder::decode_header() {
+	
+	if(format == LZMA1Stream) {
+		
+		boost::uint8_t properties = next_byte();
+		char header[4];
+		for(size_t i = 0; i < sizeof(header); i++) {
+			header[i] = char(next_byte());
+		}
+		if(properties >= 9 * 5 * 5) {
+			throw lzma_error("inno lzma1 property error", 0);
+		}
+		set_properties(properties);
+		dict_size = util::little_endian::load<boost::uint32_t>(header);
+		
+		reset_dictionary();
+		reset_state();
+		init_range_decoder();
+		stage = LZMA1Data;
+		
+	} else {
+		
+		dict_size = lzma2_dictionary_size(next_byte());
+		
+		stage = LZMA2Control;
+		
+	}
+	
+	// The window must be able to hold the output of one step in addition to the dictionary
+	window_size = std::max(size_t(dict_size), max_step_output + match_max_length);
+	
+}
+
+void inno_lzma_decoder::decode_control() {
+	
+	boost::uint8_t control = next_byte();
+	
+	if(control == 0x00) {
+		stage = StreamEnd;
+		return;
+	}
+	
+	if(control == 0x01 || control >= 0xe0) {
+		reset_dictionary();
+	} else if(need_dictionary_reset) {
+		throw lzma_error("lzma2 dictionary not initialized", 0);
+	}
+	
+	if(control < 0x80) {
+		
+		if(control > 0x02) {
+			throw lzma_error("invalid lzma2 chunk", 0);
+		}
+		
+		chunk_unpacked = (boost::uint32_t(next_byte()) << 8);
+		chunk_unpacked += boost::uint32_t(next_byte()) + 1;
+		stage = LZMA2Uncompressed;
+		
+	} else {
+		
+		chunk_unpacked = boost::uint32_t(control & 0x1f) << 16;
+		chunk_unpacked += boost::uint32_t(next_byte()) << 8;
+		chunk_unpacked += boost::uint32_t(next_byte()) + 1;
+		chunk_packed = boost::uint32_t(next_byte()) << 8;
+		chunk_packed += boost::uint32_t(next_byte()) + 1;
+		
+		if(control >= 0xc0) {
+			boost::uint8_t properties = next_byte();
+			if(properties >= 9 * 5 * 5) {
+				throw lzma_error("lzma2 property error", 0);
+			}
+			set_properties(properties);
+			if(lc + lp > 4) {
+				throw lzma_error("lzma2 property error", 0);
+			}
+		} else if(need_properties) {
+			throw lzma_error("lzma2 properties not initialized", 0);
+		}
+		
+		if(control >= 0xa0) {
+			reset_state();
+		}
+		
+		if(chunk_packed < 5) {
+			throw lzma_error("invalid lzma2 chunk", 0);
+		}
+		size_t start = in_pos;
+		init_range_decoder();
+		chunk_packed -= boost::uint32_t(in_pos - start);
+		stage = LZMA2Compressed;
+		
+	}
+	
+}
+
+void inno_lzma_decoder::decode_chunk(size_t limit) {
+	
+	size_t start = in_pos;
+	boost::uint64_t start_history = history;
+	
+	if(decode_symbols(std::min(limit, size_t(chunk_unpacked))) || history - start_history > chunk_unpacked
+	   || in_pos - start > chunk_packed) {
+		throw lzma_error("lzma2 chunk size mismatch", 0);
+	}
+	
+	chunk_unpacked -= boost::uint32_t(history - start_history);
+	chunk_packed -= boost::uint32_t(in_pos - start);
+	
+	if(chunk_unpacked == 0) {
+		if(chunk_packed != 0) {
+			throw lzma_error("lzma2 chunk size mismatch", 0);
+		}
+		stage = LZMA2Control;
+	}
+	
+}
+
+void inno_lzma_decoder::copy_uncompressed(size_t limit) {
+	
+	size_t n = std::min(size_t(chunk_unpacked), std::min(in_end - in_pos, limit));
+	
+	reserve(n);
+	for(size_t done = 0; done < n;) {
+		if(window_pos == window.size()) {
+			window_pos = 0;
+		}
+		size_t count = std::min(n - done, window.size() - window_pos);
+		std::memcpy(&window[0] + window_pos, &input[0] + in_pos, count);
+		window_pos += count, in_pos += count, done += count;
+	}
+	history += n, pending += n;
+	
+	chunk_unpacked -= boost::uint32_t(n);
+	if(chunk_unpacked == 0) {
+		stage = LZMA2Control;
+	}
+	
+}
+
+void inno_lzma_decoder::set_properties(boost::uint8_t properties) {
+	
+	lc = properties % 9;
+	properties /= 9;
+	lp = properties % 5;
+	pb = properties / 5;
+	
+	probs.resize(literal + (literal_coder_size << (lc + lp)));
+	need_properties = false;
+	
+}
+
+void inno_lzma_decoder::reset_state() {
+	
+	std::fill(probs.begin(), probs.end(), probability_init);
+	state = 0;
+	rep0 = rep1 = rep2 = rep3 = 0;
+	
+}
+
+void inno_lzma_decoder::reset_dictionary() {
+	
+	history = 0;
+	need_dictionary_reset = false;
+	
+}
+
+void inno_lzma_decoder::init_range_decoder() {
+	
+	range = 0xffffffff;
+	code = 0;
+	
+	if(next_byte() != 0) {
+		throw lzma_error("lzma range decoder error", 0);
+	}
+	for(int i = 0; i < 4; i++) {
+		code = (code << 8) | next_byte();
+	}
+	
+	if(code == range) {
+		throw lzma_error("lzma range decoder error", 0);
+	}
+	
+}
+
+inline boost::uint8_t inno_lzma_decoder::next_byte() {
+	// Overruns are detected by the caller
+	return input[in_pos++];
+}
+
+void inno_lzma_decoder::reserve(size_t count) {
+	
+	// Grow the window on demand until it reaches the dictionary size
+	if(window.size() < window_size && window_pos + count > window.size()) {
+		size_t size = std::max(window.size() * 2, window_pos + count);
+		if(window.empty()) {
+			size = std::max(size, size_t(std::min(allocation, boost::uint64_t(window_size))));
+		}
+		window.resize(std::min(std::max(size, input_buffer_size), window_size));
+	}
+	
+}
+
+/*!
+ * Decode literals and matches until at least \c limit bytes have been decoded or the input
+ * buffer runs low. At least one symbol is always decoded.
+ *
+ * \return \c true if the end marker was found.
+ */
+bool inno_lzma_decoder::decode_symbols(size_t limit) {
+	
+	// Make sure the window is not reallocated while decoding
+	reserve(limit + match_max_length);
+	
+	range_decoder rc;
+	rc.range = range;
+	rc.code = code;
+	rc.next = &input[0] + in_pos;
+	const boost::uint8_t * in_last = &input[0] + in_end; // Further reads return padding
+	
+	boost::uint16_t * p = &probs[0];
+	boost::uint8_t * dict = &window[0];
+	const size_t dict_end = window.size();
+	size_t pos = window_pos;
+	boost::uint64_t decoded = history;
+	const boost::uint64_t end = history + limit;
+	
+	const boost::uint64_t pos_mask = (1u << pb) - 1;
+	const boost::uint64_t literal_pos_mask = (1u << lp) - 1;
+	
+	boost::uint32_t s = state;
+	boost::uint32_t r0 = rep0, r1 = rep1, r2 = rep2, r3 = rep3;
+	bool end_marker = false;
+	
+	do {
+		
+		unsigned pos_state = unsigned(decoded & pos_mask);
+		
+		if(!rc.decode_bit(p[is_match + (s << max_pos_bits) + pos_state])) {
+			
+			unsigned previous = decoded ? dict[(pos ? pos : dict_end) - 1] : 0;
+			unsigned lit_state = unsigned(((decoded & literal_pos_mask) << lc) + (previous >> (8 - lc)));
+			boost::uint16_t * lit = p + literal + literal_coder_size * lit_state;
+			
+			unsigned symbol;
+			if(s >= 7) {
+				if(r0 >= decoded) {
+					throw lzma_error("lzma data error", 0);
+				}
+				size_t distance = size_t(r0) + 1;
+				symbol = rc.decode_matched_literal(lit, dict[pos >= distance ? pos - distance
+				                                                             : pos + dict_end - distance]);
+			} else {
+				symbol = 1;
+				do {
+					symbol = (symbol << 1) | rc.decode_value_bit(lit[symbol]);
+				} while(symbol < 0x100);
+			}
+			
+			if(pos == dict_end) {
+				pos = 0;
+			}
+			dict[pos++] = boost::uint8_t(symbol);
+			decoded++;
+			
+			s = s < 4 ? 0 : (s < 10 ? s - 3 : s - 6);
+			
+			continue;
+		}
+		
+		boost::uint32_t length;
+		
+		if(rc.decode_bit(p[is_rep + s])) {
+			
+			if(decoded == 0) {
+				throw lzma_error("lzma data error", 0);
+			}
+			
+			if(!rc.decode_bit(p[is_rep_g0 + s])) {
+				if(!rc.decode_bit(p[is_rep0_long + (s << max_pos_bits) + pos_state])) {
+					// Short rep
+					if(r0 >= decoded) {
+						throw lzma_error("lzma data error", 0);
+					}
+					s = s < 7 ? 9 : 11;
+					size_t distance = size_t(r0) + 1;
+					boost::uint8_t byte = dict[pos >= distance ? pos - distance : pos + dict_end - distance];
+					if(pos == dict_end) {
+						pos = 0;
+					}
+					dict[pos++] = byte;
+					decoded++;
+					continue;
+				}
+			} else {
+				boost::uint32_t distance;
+				if(!rc.decode_bit(p[is_rep_g1 + s])) {
+					distance = r1;
+				} else {
+					if(!rc.decode_bit(p[is_rep_g2 + s])) {
+						distance = r2;
+					} else {
+						distance = r3;
+						r3 = r2;
+					}
+					r2 = r1;
+				}
+				r1 = r0;
+				r0 = distance;
+			}
+			
+			length = rc.decode_length(p + rep_length_coder, pos_state);
+			s = s < 7 ? 8 : 11;
+			
+		} else {
+			
+			r3 = r2, r2 = r1, r1 = r0;
+			length = rc.decode_length(p + length_coder, pos_state);
+			s = s < 7 ? 7 : 10;
+			
+			// Decode the match distance
+			unsigned len_state = std::min(unsigned(length), length_to_pos_states - 1);
+			unsigned slot = rc.decode_tree(p + pos_slot + (len_state << pos_slot_bits), pos_slot_bits);
+			if(slot < 4) {
+				r0 = slot;
+			} else {
+				unsigned direct_bits = (slot >> 1) - 1;
+				r0 = (2 | (slot & 1)) << direct_bits;
+				if(slot < end_pos_model_index) {
+					r0 += rc.decode_reverse_tree(p + pos_special + r0 - slot, direct_bits);
+				} else {
+					r0 += rc.decode_direct_bits(direct_bits - align_bits) << align_bits;
+					r0 += rc.decode_reverse_tree(p + align, align_bits);
+				}
+			}
+			
+			if(r0 == 0xffffffff) {
+				end_marker = true;
+				break;
+			}
+			
+		}
+		
+		if(r0 >= dict_size || r0 >= decoded) {
+			throw lzma_error("lzma data error", 0);
+		}
+		
+		length += match_min_length;
+		
+		size_t distance = size_t(r0) + 1;
+		if(pos >= distance && pos + length <= dict_end) {
+			boost::uint8_t * out = dict + pos;
+			const boost::uint8_t * match = out - distance;
+			if(distance >= length) {
+				std::memcpy(out, match, length);
+			} else {
+				for(boost::uint32_t i = 0; i < length; i++) {
+					out[i] = match[i];
+				}
+			}
+			pos += length;
+		} else {
+			size_t from = pos >= distance ? pos - distance : pos + dict_end - distance;
+			for(boost::uint32_t i = 0; i < length; i++) {
+				if(pos == dict_end) {
+					pos = 0;
+				}
+				dict[pos++] = dict[from++];
+				if(from == dict_end) {
+					from = 0;
+				}
+			}
+		}
+		decoded += length;
+		
+	} while(decoded < end && in_last - rc.next >= std::ptrdiff_t(max_symbol_input));
+	
+	range = rc.range;
+	code = rc.code;
+	in_pos = size_t(rc.next - &input[0]);
+	state = s;
+	rep0 = r0, rep1 = r1, rep2 = r2, rep3 = r3;
+	window_pos = pos;
+	pending += size_t(decoded - history);
+	history = decoded;
+	
+	return end_marker;
+}
+
+boost::uint64_t inno_lzma_decoder::state_size() const {
+	
+	boost::uint64_t size = 8 + 4 * 10 + 8 * 3;
+	size += 4 + 2 * boost::uint64_t(probs.size());
+	size += std::min(history, boost::uint64_t(window_size));
+	
+	return size;
+}
+
+void inno_lzma_decoder::save(std::ostream & os) const {
+	
+	boost::uint8_t flags = boost::uint8_t((need_dictionary_reset ? 1 : 0) | (need_properties ? 2 : 0));
+	store(os, state_version);
+	store(os, boost::uint8_t(format));
+	store(os, boost::uint8_t(stage));
+	store(os, flags);
+	store(os, boost::uint8_t(lc));
+	store(os, boost::uint8_t(lp));
+	store(os, boost::uint8_t(pb));
+	store(os, boost::uint8_t(0));
+	store(os, dict_size);
+	store(os, chunk_unpacked);
+	store(os, chunk_packed);
+	store(os, range);
+	store(os, code);
+	store(os, state);
+	store(os, rep0);
+	store(os, rep1);
+	store(os, rep2);
+	store(os, rep3);
+	store(os, history);
+	store(os, input_position());
+	store(os, output);
+	
+	store(os, boost::uint32_t(probs.size()));
+	for(size_t i = 0; i < probs.size(); i++) {
+		store(os, probs[i]);
+	}
+	
+	// Write the dictionary contents in order, oldest byte first
+	size_t size = size_t(std::min(history, boost::uint64_t(window_size)));
+	if(size == 0) {
+		return;
+	}
+	size_t start = window_pos >= size ? window_pos - size : window_pos + window.size() - size;
+	size_t n = std::min(size, window.size() - start);
+	os.write(reinterpret_cast<const char *>(&window[0] + start), std::streamsize(n));
+	os.write(reinterpret_cast<const char *>(&window[0]), std::streamsize(size - n));
+	
+}
+
+void inno_lzma_decoder::load(std::istream & is) {
+	
+	if(util::load<boost::uint8_t>(is) != state_version
+	   || util::load<boost::uint8_t>(is) != boost::uint8_t(format)) {
+		throw lzma_error("unsupported lzma decoder state", 0);
+	}
+	
+	boost::uint8_t stored_stage = util::load<boost::uint8_t>(is);
+	boost::uint8_t flags = util::load<boost::uint8_t>(is);
+	lc = util::load<boost::uint8_t>(is);
+	lp = util::load<boost::uint8_t>(is);
+	pb = util::load<boost::uint8_t>(is);
+	(void)util::load<boost::uint8_t>(is);
+	dict_size = util::load<boost::uint32_t>(is);
+	chunk_unpacked = util::load<boost::uint32_t>(is);
+	chunk_packed = util::load<boost::uint32_t>(is);
+	range = util::load<boost::uint32_t>(is);
+	code = util::load<boost::uint32_t>(is);
+	state = util::load<boost::uint32_t>(is);
+	rep0 = util::load<boost::uint32_t>(is);
+	rep1 = util::load<boost::uint32_t>(is);
+	rep2 = util::load<boost::uint32_t>(is);
+	rep3 = util::load<boost::uint32_t>(is);
+	history = util::load<boost::uint64_t>(is);
+	input_base = util::load<boost::uint64_t>(is);
+	output = util::load<boost::uint64_t>(is);
+	
+	if(stored_stage == StreamHeader || stored_stage > StreamEnd || lc > 8 || lp > 4 || pb > 4
+	   || state >= states) {
+		throw lzma_error("invalid lzma decoder state", 0);
+	}
+	stage = decoder_stage(stored_stage);
+	need_dictionary_reset = (flags & 1) != 0;
+	need_properties = (flags & 2) != 0;
+	window_size = std::max(size_t(dict_size), max_step_output + match_max_length);
+	
+	size_t count = util::load<boost::uint32_t>(is);
+	if(count != (need_properties ? 0 : literal + (literal_coder_size << (lc + lp)))) {
+		throw lzma_error("invalid lzma decoder state", 0);
+	}
+	probs.resize(count);
+	for(size_t i = 0; i < probs.size(); i++) {
+		probs[i] = util::load<boost::uint16_t>(is);
+	}
+	
+	window_pos = size_t(std::min(history, boost::uint64_t(window_size)));
+	window.resize(window_pos);
+	if(window_pos != 0) {
+		is.read(reinterpret_cast<char *>(&window[0]), std::streamsize(window_pos));
+	}
+	
+	if(is.fail()) {
+		throw lzma_error("could not read lzma decoder state", 0);
+	}
+	
+	next_checkpoint = output;
+	
+}
+
+} // namespace stream
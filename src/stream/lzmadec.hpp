@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Built-in LZMA 1 and 2 decoder with support for saving and restoring the decoder state.
+ */
+#ifndef INNOEXTRACT_STREAM_LZMADEC_HPP
+#define INNOEXTRACT_STREAM_LZMADEC_HPP
+
+#include <stddef.h>
+#include <iosfwd>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/filter/symmetric.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace stream {
+
+class inno_lzma_decoder;
+
+//! Receives the decoder state at regular intervals while decoding a stream.
+class lzma_checkpoint_sink {
+	
+public:
+	
+	virtual ~lzma_checkpoint_sink() { }
+	
+	/*!
+	 * Called once the decoder has reached the requested output position.
+	 *
+	 * The decoder state can be stored using \ref inno_lzma_decoder::save from within
+	 * this function.
+	 *
+	 * \return the output position at which this function should be called again.
+	 */
+	virtual boost::uint64_t checkpoint(const inno_lzma_decoder & decoder) = 0;
+	
+};
+
+/*!
+ * Decoder for the LZMA1 and LZMA2 streams used by Inno Setup.
+ *
+ * Unlike liblzma, this decoder allows to save its complete state between two symbols.
+ * Decompression can later be resumed from that point without decoding the preceding data.
+ *
+ * Compressed data is buffered internally so that the decoder never has to suspend in the
+ * middle of a symbol. Symbols are decoded in runs directly into the dictionary, from which
+ * they are copied to the output buffer.
+ */
+class inno_lzma_decoder : private boost::noncopyable {
+	
+public:
+	
+	typedef char char_type;
+	
+	enum stream_format {
+		LZMA1Stream, //!< Inno Setup LZMA1 stream (see \ref inno_lzma1_decompressor)
+		LZMA2Stream  //!< Inno Setup LZMA2 stream (see \ref inno_lzma2_decompressor)
+	};
+	
+	/*!
+	 * \param format      The stream format to decode.
+	 * \param sink        Receiver for decoder checkpoints or \c NULL.
+	 * \param saved_state Decoder state previously written by \ref save or \c NULL to start
+	 *                    at the beginning of the stream. If a state is given, the input data
+	 *                    must start at \ref input_position() of that state.
+	 */
+	inno_lzma_decoder(stream_format format, const boost::shared_ptr<lzma_checkpoint_sink> & sink,
+	                  std::istream * saved_state);
+	
+	bool filter(const char * & begin_in, const char * end_in,
+	            char * & begin_out, char * end_out, bool flush);
+	
+	void close();
+	
+	//! \return the number of compressed bytes consumed, including the stream header.
+	boost::uint64_t input_position() const { return input_base + boost::uint64_t(in_pos); }
+	
+	//! \return the number of decompressed bytes returned.
+	boost::uint64_t output_position() const { return output; }
+	
+	//! \return the dictionary size of the stream.
+	boost::uint32_t dictionary_size() const { return dict_size; }
+	
+	//! \return the number of bytes written by \ref save.
+	boost::uint64_t state_size() const;
+	
+	/*!
+	 * Allocate the dictionary for \c size bytes of output when decoding starts.
+	 *
+	 * By default the dictionary is grown as needed until it reaches the dictionary size
+	 * of the stream. The allocation never exceeds that size, and the dictionary will still
+	 * grow if more than \c size bytes are decoded.
+	 */
+	void reserve_dictionary(boost::uint64_t size) { allocation = size; }
+	
+	//! Write the decoder state to a stream.
+	void save(std::ostream & os) const;
+	
+private:
+	
+	enum decoder_stage {
+		StreamHeader,
+		LZMA1Data,
+		LZMA2Control,
+		LZMA2Compressed,
+		LZMA2Uncompressed,
+		StreamEnd
+	};
+	
+	void load(std::istream & is);
+	
+	bool fill(const char * & begin_in, const char * end_in);
+	void flush_output(char * & begin_out, char * end_out);
+	
+	void decode_header();
+	void decode_control();
+	void decode_chunk(size_t limit);
+	void copy_uncompressed(size_t limit);
+	bool decode_symbols(size_t limit);
+	
+	void set_properties(boost::uint8_t properties);
+	void reset_state();
+	void reset_dictionary();
+	
+	void init_range_decoder();
+	boost::uint8_t next_byte();
+	
+	void reserve(size_t count);
+	
+	stream_format format;
+	decoder_stage stage;
+	
+	boost::shared_ptr<lzma_checkpoint_sink> sink;
+	boost::uint64_t next_checkpoint;
+	
+	// Buffered compressed data
+	std::vector<boost::uint8_t> input;
+	size_t in_pos;
+	size_t in_end;
+	boost::uint64_t input_base; //!< Stream position of the start of the input buffer
+	
+	// Stream properties
+	unsigned lc, lp, pb;
+	boost::uint32_t dict_size;
+	bool need_dictionary_reset;
+	bool need_properties;
+	
+	// LZMA2 chunk
+	boost::uint32_t chunk_unpacked; //!< Remaining uncompressed bytes in the current chunk
+	boost::uint32_t chunk_packed;   //!< Remaining compressed bytes in the current chunk
+	
+	// Range decoder
+	boost::uint32_t range;
+	boost::uint32_t code;
+	
+	// LZMA state
+	boost::uint32_t state;
+	boost::uint32_t rep0, rep1, rep2, rep3;
+	std::vector<boost::uint16_t> probs;
+	
+	// Dictionary
+	std::vector<boost::uint8_t> window;
+	size_t window_size; //!< Size of the window once it is completely filled
+	size_t window_pos;
+	boost::uint64_t allocation; //!< Requested initial size of the window
+	boost::uint64_t history; //!< Bytes decoded since the last dictionary reset
+	size_t pending;          //!< Bytes in the window that have not been returned yet
+	boost::uint64_t output;
+	
+};
+
+/*!
+ * A filter that decompresses the LZMA1 or LZMA2 streams found in Inno Setup installers
+ * using \ref inno_lzma_decoder and records checkpoints, to be used with boost::iostreams.
+ */
+class inno_lzma_checkpoint_decompressor
+	: public boost::iostreams::symmetric_filter<inno_lzma_decoder> {
+	
+public:
+	
+	inno_lzma_checkpoint_decompressor(inno_lzma_decoder::stream_format format,
+	                                  const boost::shared_ptr<lzma_checkpoint_sink> & sink,
+	                                  std::istream * state, std::streamsize buffer_size)
+		: boost::iostreams::symmetric_filter<inno_lzma_decoder>(buffer_size, format, sink, state)
+	{ }
+	
+};
+
+/*!
+ * A filter that decompresses the LZMA1 or LZMA2 streams found in Inno Setup installers
+ * using \ref inno_lzma_decoder, to be used with boost::iostreams.
+ *
+ * Used for all LZMA streams if innoextract is built without liblzma.
+ */
+class inno_lzma_builtin_decompressor
+	: public boost::iostreams::symmetric_filter<inno_lzma_decoder> {
+	
+public:
+	
+	/*!
+	 * \param format      The stream format to decode.
+	 * \param size        Number of decompressed bytes that will be read or \c 0 if unknown,
+	 *                    see \ref inno_lzma_decoder::reserve_dictionary.
+	 * \param buffer_size Size of the compressed data buffer.
+	 */
+	inno_lzma_builtin_decompressor(inno_lzma_decoder::stream_format format, boost::uint64_t size,
+	                               std::streamsize buffer_size)
+		: boost::iostreams::symmetric_filter<inno_lzma_decoder>(buffer_size, format,
+		                                                        boost::shared_ptr<lzma_checkpoint_sink>(),
+		                                                        static_cast<std::istream *>(NULL)) {
+		filter().reserve_dictionary(size);
+	}
+	
+};
+
+} // namespace stream
+
+#endif // INNOEXTRACT_STREAM_LZMADEC_HPP
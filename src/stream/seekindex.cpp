@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "stream/seekindex.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "stream/chunk.hpp"
+#include "stream/lzmadec.hpp"
+#include "util/endian.hpp"
+#include "util/load.hpp"
+#include "util/log.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace stream {
+
+namespace {
+
+const char index_magic[8] = { 'i', 'e', 's', 'e', 'e', 'k', 0x1a, 1 };
+
+//! Size of a record header: chunk id, output and input position, state size
+const boost::uint64_t record_header_size = 4 + 4 + 8 + 1 + 8 + 8 + 8;
+
+//! Minimum distance between two checkpoints in the decompressed data.
+const boost::uint64_t min_checkpoint_interval = boost::uint64_t(64) << 20;
+
+template <class T>
+void store(std::ostream & os, T value) {
+	char buffer[sizeof(T)];
+	util::little_endian::store(value, buffer);
+	os.write(buffer, std::streamsize(sizeof(buffer)));
+}
+
+} // anonymous namespace
+
+class seek_index::chunk_recorder : public lzma_checkpoint_sink {
+	
+	seek_index & index;
+	chunk_id chunk;
+	
+public:
+	
+	chunk_recorder(seek_index & seek, const chunk_id & id) : index(seek), chunk(id) { }
+	
+	boost::uint64_t checkpoint(const inno_lzma_decoder & decoder) {
+		return index.record(chunk, decoder);
+	}
+	
+};
+
+bool seek_index::chunk_id::operator<(const chunk_id & o) const {
+	
+	if(first_slice != o.first_slice) {
+		return (first_slice < o.first_slice);
+	} else if(offset != o.offset) {
+		return (offset < o.offset);
+	} else if(size != o.size) {
+		return (size < o.size);
+	}
+	
+	return (compression < o.compression);
+}
+
+seek_index::chunk_id seek_index::id(const chunk & chunk) {
+	chunk_id result = { chunk.first_slice, chunk.offset, chunk.size, boost::uint8_t(chunk.compression) };
+	return result;
+}
+
+seek_index::seek_index(const fs::path & file, const std::string & identity)
+	: path(file), end(0), writable(true) {
+	
+	if(fs::exists(path)) {
+		load(identity);
+	}
+	
+	if(end == 0) {
+		create(identity);
+	} else {
+		if(fs::file_size(path) != end) {
+			// Drop an incompletely written checkpoint
+			fs::resize_file(path, end);
+		}
+		ofs.open(path, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+	}
+	
+	if(!ofs.is_open() || ofs.fail()) {
+		log_warning << "Could not write seek index \"" << path.string() << '"';
+		writable = false;
+	}
+	
+}
+
+void seek_index::load(const std::string & identity) {
+	
+	util::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+	
+	char magic[sizeof(index_magic)];
+	if(ifs.read(magic, std::streamsize(sizeof(magic))).fail()
+	   || std::memcmp(magic, index_magic, sizeof(index_magic)) != 0) {
+		log_warning << "Ignoring invalid seek index \"" << path.string() << '"';
+		return;
+	}
+	
+	boost::uint64_t size = fs::file_size(path);
+	
+	boost::uint32_t length = util::load<boost::uint32_t>(ifs);
+	if(ifs.fail() || length != identity.length()) {
+		log_info << "Discarding seek index for a different installer";
+		return;
+	}
+	std::string stored(length, '\0');
+	if(length != 0 && ifs.read(&stored[0], std::streamsize(length)).fail()) {
+		return;
+	}
+	if(stored != identity) {
+		log_info << "Discarding seek index for a different installer";
+		return;
+	}
+	
+	boost::uint64_t position = sizeof(index_magic) + 4 + boost::uint64_t(length);
+	
+	size_t count = 0;
+	while(position + record_header_size <= size) {
+		
+		chunk_id chunk;
+		chunk.first_slice = util::load<boost::uint32_t>(ifs);
+		chunk.offset = util::load<boost::uint32_t>(ifs);
+		chunk.size = util::load<boost::uint64_t>(ifs);
+		chunk.compression = util::load<boost::uint8_t>(ifs);
+		
+		checkpoint entry;
+		entry.output = util::load<boost::uint64_t>(ifs);
+		entry.input = util::load<boost::uint64_t>(ifs);
+		boost::uint64_t state_size = util::load<boost::uint64_t>(ifs);
+		entry.offset = position + record_header_size;
+		
+		if(ifs.fail() || state_size > size - entry.offset) {
+			break;
+		}
+		
+		position = entry.offset + state_size;
+		if(ifs.seekg(std::streamoff(position)).fail()) {
+			break;
+		}
+		
+		index[chunk][entry.output] = entry;
+		count++;
+	}
+	
+	end = position;
+	
+	debug("[loaded " << count << " checkpoints from seek index]");
+	
+}
+
+void seek_index::create(const std::string & identity) {
+	
+	ofs.open(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	
+	ofs.write(index_magic, std::streamsize(sizeof(index_magic)));
+	store(ofs, boost::uint32_t(identity.length()));
+	ofs.write(identity.c_str(), std::streamsize(identity.length()));
+	ofs.flush();
+	
+	end = sizeof(index_magic) + 4 + boost::uint64_t(identity.length());
+	
+}
+
+bool seek_index::find(const chunk & chunk, boost::uint64_t position, checkpoint & result) const {
+	
+	util::scoped_lock<util::mutex> lock(mutex);
+	
+	std::map<chunk_id, checkpoints>::const_iterator i = index.find(id(chunk));
+	if(i == index.end()) {
+		return false;
+	}
+	
+	checkpoints::const_iterator j = i->second.upper_bound(position);
+	if(j == i->second.begin()) {
+		return false;
+	}
+	
+	result = (--j)->second;
+	
+	return true;
+}
+
+bool seek_index::open(const checkpoint & entry, util::ifstream & ifs) const {
+	
+	ifs.open(path, std::ios_base::in | std::ios_base::binary);
+	
+	return ifs.is_open() && !ifs.seekg(std::streamoff(entry.offset)).fail();
+}
+
+boost::shared_ptr<lzma_checkpoint_sink> seek_index::recorder(const chunk & chunk) {
+	return boost::shared_ptr<lzma_checkpoint_sink>(new chunk_recorder(*this, id(chunk)));
+}
+
+boost::uint64_t seek_index::record(const chunk_id & chunk, const inno_lzma_decoder & decoder) {
+	
+	// Limit the index size for large dictionaries as each checkpoint includes the dictionary
+	boost::uint64_t interval = std::max(min_checkpoint_interval,
+	                                    boost::uint64_t(decoder.dictionary_size()) * 4);
+	boost::uint64_t position = decoder.output_position();
+	
+	util::scoped_lock<util::mutex> lock(mutex);
+	
+	checkpoints & entries = index[chunk];
+	boost::uint64_t last = entries.empty() ? 0 : entries.rbegin()->first;
+	if(!writable || position < last + interval) {
+		return last + interval;
+	}
+	
+	boost::uint64_t state_size = decoder.state_size();
+	
+	store(ofs, chunk.first_slice);
+	store(ofs, chunk.offset);
+	store(ofs, chunk.size);
+	store(ofs, chunk.compression);
+	store(ofs, position);
+	store(ofs, decoder.input_position());
+	store(ofs, state_size);
+	decoder.save(ofs);
+	ofs.flush();
+	
+	if(ofs.fail()) {
+		log_warning << "Could not write seek index \"" << path.string() << '"';
+		writable = false;
+		return position + interval;
+	}
+	
+	checkpoint entry = { position, decoder.input_position(), end + record_header_size };
+	entries[position] = entry;
+	end += record_header_size + state_size;
+	
+	debug("[recorded checkpoint @ " << position << " in chunk " << chunk.first_slice << " + "
+	      << chunk.offset << ']');
+	
+	return position + interval;
+}
+
+} // namespace stream
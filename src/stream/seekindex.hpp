@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Persistent index of decoder checkpoints for seeking in compressed chunks.
+ */
+#ifndef INNOEXTRACT_STREAM_SEEKINDEX_HPP
+#define INNOEXTRACT_STREAM_SEEKINDEX_HPP
+
+#include <map>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "util/fstream.hpp"
+#include "util/thread.hpp"
+
+namespace stream {
+
+struct chunk;
+class inno_lzma_decoder;
+class lzma_checkpoint_sink;
+
+/*!
+ * Sidecar file storing decoder checkpoints for solid LZMA chunks.
+ *
+ * Checkpoints are recorded at regular intervals while chunks are decoded by
+ * \ref chunk_reader. Later runs can then start decoding a chunk at the last checkpoint
+ * before the requested data instead of at the start of the chunk.
+ *
+ * New checkpoints are appended to the file as they are recorded so that an interrupted
+ * run still leaves a usable index.
+ *
+ * All member functions may be called concurrently.
+ */
+class seek_index : private boost::noncopyable {
+	
+public:
+	
+	struct checkpoint {
+		
+		boost::uint64_t output; //!< Position in the decompressed chunk data.
+		boost::uint64_t input;  //!< Position in the compressed chunk data after the chunk magic.
+		boost::uint64_t offset; //!< Position of the saved decoder state in the index file.
+		
+	};
+	
+	/*!
+	 * Load or create a seek index.
+	 *
+	 * \param file     The index file.
+	 * \param identity Data identifying the installer. If the existing index was created for
+	 *                 a different identity, it is discarded.
+	 */
+	seek_index(const boost::filesystem::path & file, const std::string & identity);
+	
+	/*!
+	 * Find the last checkpoint in a chunk at or before a position.
+	 *
+	 * \param chunk    The chunk to search.
+	 * \param position Position in the decompressed chunk data.
+	 * \param result   Receives the checkpoint.
+	 *
+	 * \return \c true if a checkpoint was found.
+	 */
+	bool find(const chunk & chunk, boost::uint64_t position, checkpoint & result) const;
+	
+	/*!
+	 * Open the saved decoder state for a checkpoint.
+	 *
+	 * \return \c true if the state could be opened.
+	 */
+	bool open(const checkpoint & entry, util::ifstream & ifs) const;
+	
+	//! \return a sink that records new checkpoints for a chunk into this index.
+	boost::shared_ptr<lzma_checkpoint_sink> recorder(const chunk & chunk);
+	
+private:
+	
+	struct chunk_id {
+		
+		boost::uint32_t first_slice;
+		boost::uint32_t offset;
+		boost::uint64_t size;
+		boost::uint8_t compression;
+		
+		bool operator<(const chunk_id & o) const;
+		
+	};
+	
+	class chunk_recorder;
+	
+	typedef std::map<boost::uint64_t, checkpoint> checkpoints;
+	
+	static chunk_id id(const chunk & chunk);
+	
+	void load(const std::string & identity);
+	void create(const std::string & identity);
+	
+	/*!
+	 * Store a checkpoint if it is far enough from existing checkpoints for the same chunk.
+	 *
+	 * \return the position at which the next checkpoint should be recorded.
+	 */
+	boost::uint64_t record(const chunk_id & chunk, const inno_lzma_decoder & decoder);
+	
+	boost::filesystem::path path;
+	
+	std::map<chunk_id, checkpoints> index;
+	
+	util::ofstream ofs;
+	boost::uint64_t end; //!< Size of the index file
+	bool writable;
+	
+	mutable util::mutex mutex;
+	
+};
+
+} // namespace stream
+
+#endif // INNOEXTRACT_STREAM_SEEKINDEX_HPP
@@ -20,15 +20,29 @@
 
 #include "stream/slice.hpp"
 
-#include <sstream>
 #include <cstring>
 #include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+
+#include "configure.hpp"
 
+#if INNOEXTRACT_HAVE_PREAD
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 
 #include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/range/size.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <boost/version.hpp>
 #if BOOST_VERSION >= 107200
@@ -36,8 +50,9 @@
 #endif
 
 #include "util/console.hpp"
-#include "util/load.hpp"
+#include "util/endian.hpp"
 #include "util/log.hpp"
+#include "util/thread.hpp"
 
 namespace stream {
 
@@ -48,29 +63,292 @@ const char slice_ids[][8] = {
 	{ 'i', 'd', 's', 'k', 'a', '3', '2', 0x1a },
 };
 
+//! \return an error message for a slice that could not be found.
+std::string missing_slice(size_t slice, const std::string & basename, const std::string & basename2,
+                          size_t slices_per_disk) {
+	
+	std::string slice_file = slice_reader::slice_filename(basename, slice, slices_per_disk);
+	std::string slice_file2 = slice_reader::slice_filename(basename2, slice, slices_per_disk);
+	
+	std::ostringstream oss;
+	oss << "could not open slice " << slice << ": " << slice_file;
+	if(!basename2.empty() && slice_file2 != slice_file) {
+		oss << " or " << slice_file2;
+	}
+	
+	return oss.str();
+}
+
+//! Size of the slice file header: magic number followed by the slice size.
+const boost::uint32_t slice_header_size = 8 + 4;
+
+//! Read the slice size from the header of a slice file that is not open.
+bool read_slice_size(const boost::filesystem::path & file, boost::uint32_t & size) {
+	
+	util::ifstream ifs(file, std::ios_base::in | std::ios_base::binary);
+	
+	char header[slice_header_size];
+	if(!ifs.read(header, std::streamsize(sizeof(header)))) {
+		return false;
+	}
+	
+	for(size_t i = 0; i < boost::size(slice_ids); i++) {
+		if(!std::memcmp(header, slice_ids[i], 8)) {
+			size = util::little_endian::load<boost::uint32_t>(header + 8);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+//! Checks the headers of multiple slice files concurrently.
+class slice_validator : public util::runnable {
+	
+	const slice_manifest & manifest;
+	const std::vector<size_t> & slices;
+	
+	util::mutex mutex;
+	size_t next_slice;
+	std::map<size_t, slice_error> errors; //!< Errors for failed slices by index in the list.
+	
+	size_t next() {
+		util::scoped_lock<util::mutex> lock(mutex);
+		return (next_slice < slices.size()) ? next_slice++ : size_t(-1);
+	}
+	
+public:
+	
+	slice_validator(const slice_manifest & slice_files, const std::vector<size_t> & slice_list)
+		: manifest(slice_files), slices(slice_list), next_slice(0)
+	{ }
+	
+	void run() {
+		slice_reader reader(manifest);
+		for(size_t i = next(); i != size_t(-1); i = next()) {
+			try {
+				reader.check(slices[i]);
+			} catch(const slice_error & e) {
+				util::scoped_lock<util::mutex> lock(mutex);
+				errors.insert(std::make_pair(i, e));
+				// Stop early - all slices before this one have already been started
+				next_slice = slices.size();
+			}
+		}
+	}
+	
+	//! Throw the error for the first failed slice, if any.
+	void report() const {
+		if(!errors.empty()) {
+			throw errors.begin()->second;
+		}
+	}
+	
+};
+
+//! Limits for the amount of data requested ahead of the read position.
+const boost::uint32_t min_prefetch_window = 256 * 1024;
+const boost::uint32_t max_prefetch_window = 64 * 1024 * 1024;
+
+//! How long it should take to consume the requested data, in microseconds.
+const boost::uint64_t prefetch_duration = 500 * 1000;
+
 } // anonymous namespace
 
 slice_reader::slice_reader(std::istream * istream, boost::uint32_t offset)
 	: data_offset(offset),
-	  slices_per_disk(1), current_slice(0), slice_size(0),
-	  is(istream) {
+	  slices_per_disk(1), manifest(NULL), current_slice(0), slice_size(0), position(0),
+	  fd(-1), is(istream) {
+	init_embedded();
+}
+
+slice_reader::slice_reader(const path_type & file, boost::uint32_t offset)
+	: data_offset(offset),
+	  slices_per_disk(1), manifest(NULL), current_slice(0), current_file(file), slice_size(0), position(0),
+	  fd(-1), is(&ifs) {
 	
-	std::streampos max_size = std::streampos(std::numeric_limits<boost::int32_t>::max());
+	if(!open_handle(file)) {
+		throw slice_error("could not open \"" + file.string() + '"');
+	}
+	
+	init_embedded();
+}
+
+void slice_reader::init_embedded() {
 	
-	std::streampos file_size = is->seekg(0, std::ios_base::end).tellg();
+	boost::uint64_t max_size = boost::uint64_t(std::numeric_limits<boost::int32_t>::max());
 	
-	slice_size = boost::uint32_t(std::min(file_size, max_size));
-	if(is->seekg(data_offset).fail()) {
+	slice_size = boost::uint32_t(std::min(handle_size(), max_size));
+	
+	position = data_offset;
+	if(fd < 0 && is->seekg(position).fail()) {
 		throw slice_error("could not seek to data");
 	}
+	
+	reset_prefetch();
 }
 
 slice_reader::slice_reader(const path_type & dirname, const std::string & basename,
                            const std::string & basename2, size_t disk_slice_count)
 	: data_offset(0),
 	  dir(dirname), base_file(basename), base_file2(basename2),
-	  slices_per_disk(disk_slice_count), current_slice(0), slice_size(0),
-	  is(&ifs) { }
+	  slices_per_disk(disk_slice_count), manifest(NULL), current_slice(0), slice_size(0), position(0),
+	  fd(-1), is(&ifs) {
+	reset_prefetch();
+}
+
+slice_reader::slice_reader(const slice_manifest & slices)
+	: data_offset(0),
+	  dir(slices.directory()), base_file(slices.basename()), base_file2(slices.basename2()),
+	  slices_per_disk(slices.slices_per_disk()), manifest(&slices), current_slice(0), slice_size(0),
+	  position(0), fd(-1), is(&ifs) {
+	reset_prefetch();
+}
+
+slice_reader::~slice_reader() {
+	close_handle();
+}
+
+bool slice_reader::open_handle(const path_type & file) {
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	
+	fd = ::open(file.c_str(), O_RDONLY);
+	return (fd >= 0);
+	
+	#else
+	
+	ifs.open(file, std::ios_base::in | std::ios_base::binary);
+	return ifs.is_open();
+	
+	#endif
+}
+
+void slice_reader::close_handle() {
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	if(fd >= 0) {
+		::close(fd);
+	}
+	#endif
+	fd = -1;
+	
+	ifs.close();
+	ifs.clear();
+}
+
+boost::uint64_t slice_reader::handle_size() {
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	if(fd >= 0) {
+		struct stat info;
+		if(::fstat(fd, &info) != 0) {
+			throw slice_error("could not determine file size");
+		}
+		return boost::uint64_t(info.st_size);
+	}
+	#endif
+	
+	std::streampos end = is->seekg(0, std::ios_base::end).tellg();
+	if(end < 0) {
+		return 0;
+	}
+	
+	return boost::uint64_t(end);
+}
+
+std::streamsize slice_reader::read_at(char * buffer, std::streamsize bytes) {
+	
+	std::streamsize nread = 0;
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	if(fd >= 0) {
+		while(nread < bytes) {
+			ssize_t result = ::pread(fd, buffer + nread, size_t(bytes - nread), off_t(position));
+			if(result < 0 && errno == EINTR) {
+				continue;
+			} else if(result <= 0) {
+				break;
+			}
+			nread += std::streamsize(result), position += boost::uint32_t(result);
+		}
+		return nread;
+	}
+	#endif
+	
+	is->read(buffer, bytes);
+	nread = is->gcount();
+	position += boost::uint32_t(nread);
+	
+	return nread;
+}
+
+void slice_reader::reset_prefetch() {
+	prefetched = position;
+	prefetch_window = min_prefetch_window;
+	prefetch_start = position;
+	prefetch_time = boost::posix_time::ptime();
+	next_prefetched = false;
+}
+
+void slice_reader::prefetch() {
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE
+	
+	if(fd < 0 || prefetched >= slice_size || position + boost::uint64_t(prefetch_window / 2) < prefetched) {
+		return;
+	}
+	
+	// Size the window so that it lasts for a fixed time at the observed consumption rate
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	if(!prefetch_time.is_not_a_date_time() && position > prefetch_start) {
+		boost::int64_t elapsed = (now - prefetch_time).total_microseconds();
+		boost::uint64_t consumed = position - prefetch_start;
+		boost::uint64_t window = max_prefetch_window;
+		if(elapsed > 0) {
+			window = consumed * prefetch_duration / boost::uint64_t(elapsed);
+		}
+		window = std::max(window, boost::uint64_t(min_prefetch_window));
+		prefetch_window = boost::uint32_t(std::min(window, boost::uint64_t(max_prefetch_window)));
+	}
+	prefetch_time = now;
+	prefetch_start = position;
+	
+	boost::uint64_t begin = std::max(boost::uint64_t(position), prefetched);
+	boost::uint64_t end = std::min(boost::uint64_t(position) + prefetch_window, boost::uint64_t(slice_size));
+	if(end > begin) {
+		(void)::posix_fadvise(fd, off_t(begin), off_t(end - begin), POSIX_FADV_WILLNEED);
+		prefetched = end;
+	}
+	
+	if(prefetched >= slice_size && data_offset == 0 && !next_prefetched) {
+		next_prefetched = true;
+		prefetch_slice(current_slice + 1);
+	}
+	
+	#endif
+}
+
+void slice_reader::prefetch_slice(size_t slice) {
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE
+	
+	path_type file = find_slice(slice);
+	if(file.empty()) {
+		return;
+	}
+	
+	int handle = ::open(file.c_str(), O_RDONLY);
+	if(handle >= 0) {
+		// The page cache is shared, so the data stays available after closing the file
+		(void)::posix_fadvise(handle, 0, off_t(prefetch_window), POSIX_FADV_WILLNEED);
+		::close(handle);
+	}
+	
+	#else
+	(void)slice;
+	#endif
+}
 
 void slice_reader::seek(size_t slice) {
 	
@@ -91,52 +369,67 @@ bool slice_reader::open_file(const path_type & file) {
 		return false;
 	}
 	
-	log_info << "Opening \"" << color::cyan << file.string() << color::reset << '"';
+	close_handle();
+	current_file.clear();
 	
-	ifs.close();
-	ifs.clear();
-	
-	ifs.open(file, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
-	if(ifs.fail()) {
+	is = &ifs;
+	if(!open_handle(file)) {
 		return false;
 	}
 	
-	std::streampos file_size = ifs.tellg();
-	ifs.seekg(0);
+	boost::uint64_t file_size = handle_size();
+	
+	position = 0;
+	if(fd < 0 && is->seekg(0).fail()) {
+		close_handle();
+		throw slice_error("could not seek in \"" + file.string() + "\"");
+	}
+	
+	char header[slice_header_size];
+	std::streamsize header_size = read_at(header, std::streamsize(sizeof(header)));
 	
-	char magic[8];
-	if(ifs.read(magic, 8).fail()) {
-		ifs.close();
+	if(header_size < 8) {
+		close_handle();
 		throw slice_error("could not read slice magic number in \"" + file.string() + "\"");
 	}
 	bool found = false;
-	for(size_t i = 0; boost::size(slice_ids); i++) {
-		if(!std::memcmp(magic, slice_ids[i], 8)) {
+	for(size_t i = 0; i < boost::size(slice_ids); i++) {
+		if(!std::memcmp(header, slice_ids[i], 8)) {
 			found = true;
 			break;
 		}
 	}
 	if(!found) {
-		ifs.close();
+		close_handle();
 		throw slice_error("bad slice magic number in \"" + file.string() + "\"");
 	}
 	
-	slice_size = util::load<boost::uint32_t>(ifs);
-	if(ifs.fail()) {
-		ifs.close();
+	if(header_size < std::streamsize(sizeof(header))) {
+		close_handle();
 		throw slice_error("could not read slice size in \"" + file.string() + "\"");
-	} else if(std::streampos(slice_size) > file_size) {
-		ifs.close();
+	}
+	slice_size = util::little_endian::load<boost::uint32_t>(header + 8);
+	if(slice_size > file_size) {
+		close_handle();
 		std::ostringstream oss;
 		oss << "bad slice size in " << file << ": " << slice_size << " > " << file_size;
 		throw slice_error(oss.str());
-	} else if(std::streampos(slice_size) < ifs.tellg()) {
-		ifs.close();
+	} else if(slice_size < position) {
+		close_handle();
 		std::ostringstream oss;
-		oss << "bad slice size in " << file << ": " << slice_size << " < " << ifs.tellg();
+		oss << "bad slice size in " << file << ": " << slice_size << " < " << position;
 		throw slice_error(oss.str());
 	}
 	
+	current_file = file;
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE
+	if(fd >= 0) {
+		(void)::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	#endif
+	reset_prefetch();
+	
 	return true;
 }
 
@@ -176,36 +469,63 @@ bool slice_reader::open_file_case_insensitive(const path_type & dirname, const p
 	return false;
 }
 
-void slice_reader::open(size_t slice) {
+bool slice_reader::open_slice(size_t slice) {
 	
-	current_slice = slice;
-	is = &ifs;
-	ifs.close();
+	if(manifest) {
+		return open_file(manifest->file(slice));
+	}
 	
 	path_type slice_file = slice_filename(base_file, slice, slices_per_disk);
 	if(open_file(dir / slice_file)) {
-		return;
+		return true;
 	}
 	
 	path_type slice_file2 = slice_filename(base_file2, slice, slices_per_disk);
 	if(!base_file2.empty() && slice_file2 != slice_file && open_file(dir / slice_file2)) {
-		return;
+		return true;
 	}
 	
 	if(open_file_case_insensitive(dir, slice_file)) {
-		return;
+		return true;
 	}
 	
 	if(!base_file2.empty() && slice_file2 != slice_file && open_file_case_insensitive(dir, slice_file2)) {
-		return;
+		return true;
 	}
 	
-	std::ostringstream oss;
-	oss << "could not open slice " << slice << ": " << slice_file;
-	if(!base_file2.empty() && slice_file2 != slice_file) {
-		oss << " or " << slice_file2;
+	return false;
+}
+
+void slice_reader::open(size_t slice) {
+	
+	current_slice = slice;
+	is = &ifs;
+	close_handle();
+	
+	if(!open_slice(slice)) {
+		throw slice_error(missing_slice(slice, base_file, base_file2, slices_per_disk));
+	}
+	
+	log_info << "Opening \"" << color::cyan << current_file.string() << color::reset << '"';
+}
+
+void slice_reader::check(size_t slice) {
+	
+	if(data_offset != 0) {
+		throw slice_error("cannot change slices in single-file setup");
+	}
+	
+	is = &ifs;
+	close_handle();
+	
+	bool found = open_slice(slice);
+	
+	close_handle();
+	current_file.clear();
+	
+	if(!found) {
+		throw slice_error(missing_slice(slice, base_file, base_file2, slices_per_disk));
 	}
-	throw slice_error(oss.str());
 }
 
 bool slice_reader::seek(size_t slice, boost::uint32_t offset) {
@@ -218,10 +538,16 @@ bool slice_reader::seek(size_t slice, boost::uint32_t offset) {
 		return false;
 	}
 	
-	if(is->seekg(offset).fail()) {
+	if(fd < 0 && is->seekg(offset).fail()) {
 		return false;
 	}
 	
+	bool sequential = (offset >= position && offset <= prefetched);
+	position = offset;
+	if(!sequential) {
+		reset_prefetch();
+	}
+	
 	return true;
 }
 
@@ -233,31 +559,206 @@ std::streamsize slice_reader::read(char * buffer, std::streamsize bytes) {
 	
 	while(bytes > 0) {
 		
-		boost::uint32_t read_pos = boost::uint32_t(is->tellg());
-		if(read_pos > slice_size) {
+		if(position > slice_size) {
 			break;
 		}
-		boost::uint32_t remaining = slice_size - read_pos;
+		boost::uint32_t remaining = slice_size - position;
 		if(!remaining) {
 			seek(current_slice + 1);
-			read_pos = boost::uint32_t(is->tellg());
-			if(read_pos > slice_size) {
+			if(position > slice_size) {
 				break;
 			}
-			remaining = slice_size - read_pos;
+			remaining = slice_size - position;
 		}
 		
+		prefetch();
+		
 		boost::uint64_t toread = std::min(boost::uint64_t(remaining), boost::uint64_t(bytes));
 		toread = std::min(toread, boost::uint64_t(std::numeric_limits<std::streamsize>::max()));
-		if(is->read(buffer, std::streamsize(toread)).fail()) {
+		std::streamsize read = read_at(buffer, std::streamsize(toread));
+		nread += read, buffer += read, bytes -= read;
+		if(read != std::streamsize(toread)) {
 			break;
 		}
-		
-		std::streamsize read = is->gcount();
-		nread += read, buffer += read, bytes -= read;
 	}
 	
 	return (nread != 0 || bytes == 0) ? nread : -1;
 }
 
+bool slice_reader::locate(size_t & slice, boost::uint32_t & offset, boost::uint64_t size,
+                          std::vector<extent> * result) {
+	
+	if(current_file.empty() && base_file.empty()) {
+		return false; // Embedded data read from a caller-provided stream
+	}
+	
+	if(!seek(slice, offset)) {
+		return false;
+	}
+	
+	boost::uint32_t file_offset = offset + data_offset;
+	
+	while(true) {
+		
+		boost::uint64_t n = std::min(boost::uint64_t(slice_size - file_offset), size);
+		if(n != 0 && result) {
+			result->push_back(extent(current_file, file_offset, n));
+		}
+		file_offset += boost::uint32_t(n), size -= n;
+		
+		if(size == 0) {
+			break;
+		}
+		
+		seek(current_slice + 1);
+		file_offset = position;
+		if(file_offset > slice_size) {
+			throw slice_error("could not locate data in slice");
+		}
+		
+	}
+	
+	slice = current_slice;
+	offset = file_offset - data_offset;
+	
+	return true;
+}
+
+bool slice_reader::find_extents(size_t slice, boost::uint32_t offset, boost::uint64_t size,
+                                std::vector<extent> & result) const {
+	
+	if(current_file.empty() && base_file.empty()) {
+		return false; // Embedded data read from a caller-provided stream
+	}
+	
+	boost::uint64_t file_offset = boost::uint64_t(offset) + data_offset;
+	
+	while(true) {
+		
+		path_type file;
+		boost::uint32_t end;
+		if(slice == current_slice && !current_file.empty()) {
+			file = current_file, end = slice_size;
+		} else {
+			file = find_slice(slice);
+			if(file.empty() || !read_slice_size(file, end)) {
+				return false;
+			}
+		}
+		
+		if(file_offset > end) {
+			return false;
+		}
+		
+		boost::uint64_t n = std::min(end - file_offset, size);
+		if(n != 0) {
+			result.push_back(extent(file, file_offset, n));
+		}
+		size -= n;
+		
+		if(size == 0) {
+			return true;
+		}
+		
+		slice++;
+		file_offset = slice_header_size;
+		
+	}
+}
+
+slice_reader::path_type slice_reader::find_slice(size_t slice) const {
+	
+	if(data_offset != 0) {
+		return (slice == 0) ? current_file : path_type();
+	}
+	
+	if(manifest) {
+		return manifest->file(slice);
+	}
+	
+	path_type file = dir / slice_filename(base_file, slice, slices_per_disk);
+	if(boost::filesystem::exists(file)) {
+		return file;
+	}
+	
+	if(!base_file2.empty()) {
+		file = dir / slice_filename(base_file2, slice, slices_per_disk);
+		if(boost::filesystem::exists(file)) {
+			return file;
+		}
+	}
+	
+	return path_type();
+}
+
+slice_manifest::slice_manifest(const path_type & dirname, const std::string & basename,
+                               const std::string & basename2, size_t slices_per_disk, size_t count)
+	: dir(dirname), base_file(basename), base_file2(basename2), disk_slice_count(slices_per_disk),
+	  files(count) {
+	
+	if(count == 0) {
+		return;
+	}
+	
+	// List the directory once, keeping both the actual and the lower-case names
+	std::set<std::string> names;
+	std::map<std::string, std::string> names_lower;
+	try {
+		boost::filesystem::directory_iterator end;
+		for(boost::filesystem::directory_iterator i(dir); i != end; ++i) {
+			std::string name = i->path().filename().string();
+			std::string name_lower = boost::to_lower_copy(name);
+			if(!boost::ends_with(name_lower, ".bin")) {
+				continue;
+			}
+			names.insert(name);
+			std::map<std::string, std::string>::iterator it = names_lower.find(name_lower);
+			if(it == names_lower.end()) {
+				names_lower[name_lower] = name;
+			} else if(name < it->second) {
+				it->second = name; // Independent of the directory order
+			}
+		}
+	} catch(const boost::filesystem::filesystem_error &) {
+		// Leave the slices unresolved, an error is reported when they are used
+	}
+	
+	for(size_t slice = 0; slice < count; slice++) {
+		
+		std::string slice_file = slice_reader::slice_filename(base_file, slice, disk_slice_count);
+		std::string slice_file2;
+		if(!base_file2.empty()) {
+			slice_file2 = slice_reader::slice_filename(base_file2, slice, disk_slice_count);
+		}
+		
+		std::map<std::string, std::string>::const_iterator it;
+		if(names.find(slice_file) != names.end()) {
+			files[slice] = dir / slice_file;
+		} else if(!slice_file2.empty() && names.find(slice_file2) != names.end()) {
+			files[slice] = dir / slice_file2;
+		} else if((it = names_lower.find(boost::to_lower_copy(slice_file))) != names_lower.end()) {
+			files[slice] = dir / it->second;
+		} else if(!slice_file2.empty()
+		          && (it = names_lower.find(boost::to_lower_copy(slice_file2))) != names_lower.end()) {
+			files[slice] = dir / it->second;
+		}
+		
+	}
+	
+}
+
+const slice_manifest::path_type & slice_manifest::file(size_t slice) const {
+	
+	static const path_type none;
+	
+	return (slice < files.size()) ? files[slice] : none;
+}
+
+void slice_manifest::validate(const std::vector<size_t> & slices, size_t threads) const {
+	
+	slice_validator validator(*this, slices);
+	util::run_threads(validator, std::max(size_t(1), std::min(threads, slices.size())));
+	validator.report();
+}
+
 } // namespace stream
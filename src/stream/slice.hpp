@@ -28,9 +28,12 @@
 
 #include <ios>
 #include <string>
+#include <vector>
 
+#include <boost/noncopyable.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/date_time/posix_time/ptime.hpp>
 
 #include "util/fstream.hpp"
 
@@ -43,6 +46,66 @@ struct slice_error : public std::ios_base::failure {
 	
 };
 
+/*!
+ * Files containing the external slices (aka disks) of an installer.
+ *
+ * All slice names are resolved up front: the slice directory is listed only once and each
+ * slice is matched against both base names, first exactly and then ignoring case. This
+ * avoids searching the directory separately for every slice.
+ *
+ * The manifest is not modified after construction and can be shared between multiple
+ * \ref slice_reader instances on different threads.
+ */
+class slice_manifest : private boost::noncopyable {
+	
+	typedef boost::filesystem::path path_type;
+	
+	path_type    dir;
+	std::string  base_file;
+	std::string  base_file2;
+	const size_t disk_slice_count;
+	
+	std::vector<path_type> files; //!< File for each slice or an empty path if not found.
+	
+public:
+	
+	/*!
+	 * Find the files for a number of slices.
+	 *
+	 * \param dirname          The directory containing the slice files.
+	 * \param basename         The base name for slice files.
+	 * \param basename2        Alternative base name for slice files.
+	 * \param slices_per_disk  How many slices are grouped into one disk. Must not be \c 0.
+	 * \param count            The number of slices to find.
+	 *
+	 * Missing slices are not an error at this point, see \ref validate().
+	 */
+	slice_manifest(const path_type & dirname, const std::string & basename, const std::string & basename2,
+	               size_t slices_per_disk, size_t count);
+	
+	const path_type & directory() const { return dir; }
+	const std::string & basename() const { return base_file; }
+	const std::string & basename2() const { return base_file2; }
+	size_t slices_per_disk() const { return disk_slice_count; }
+	
+	//! \return the number of slices in the manifest.
+	size_t size() const { return files.size(); }
+	
+	//! \return the file containing a slice or an empty path if it was not found.
+	const path_type & file(size_t slice) const;
+	
+	/*!
+	 * Check that slice files exist and have a valid header.
+	 *
+	 * \param slices  The slices to check.
+	 * \param threads How many files to check concurrently.
+	 *
+	 * \throws slice_error for the first missing or invalid slice.
+	 */
+	void validate(const std::vector<size_t> & slices, size_t threads) const;
+	
+};
+
 /*!
  * Abstraction for reading either data embedded inside the setup executable or from
  * multiple external slices.
@@ -53,8 +116,17 @@ struct slice_error : public std::ios_base::failure {
  * The contained data is made up of one or more \ref chunk "chunks"
  * (read by \ref chunk_reader), which in turn contain one or more  \ref file "files"
  * (read by \ref file_reader).
+ *
+ * Where supported, files opened by the reader are accessed using positional reads with
+ * the read position tracked by the reader itself. This avoids seeking or querying the
+ * position of a shared stream, so each read is a single system call.
+ *
+ * The reader also asks the kernel to load data ahead of the current read position so that
+ * slow storage is accessed while earlier data is still being decompressed. The read-ahead
+ * window is adjusted to how fast data is consumed. When the end of a slice comes within
+ * the window, the next slice file is warmed up as well.
  */
-class slice_reader : public boost::iostreams::source {
+class slice_reader : public boost::iostreams::source, private boost::noncopyable {
 	
 	typedef boost::filesystem::path path_type;
 	
@@ -66,22 +138,68 @@ class slice_reader : public boost::iostreams::source {
 	std::string  base_file;       //!< Base file name for slices.
 	std::string  base_file2;      //!< Fallback base filename for slices.
 	const size_t slices_per_disk; //!< Number of slices grouped into each disk (for names).
+	const slice_manifest * manifest; //!< Files for the slices if found in advance.
 	
 	// Information about the current slice
 	size_t          current_slice; //!< Number of the currently opened slice.
+	path_type       current_file;  //!< File containing the current slice, if any.
 	boost::uint32_t slice_size;    //!< Size in bytes of the currently opened slice.
+	boost::uint32_t position;      //!< Read position in the file containing the current slice.
+	
+	// Read-ahead state for the current slice
+	boost::uint64_t          prefetched;      //!< End of the range requested from the kernel.
+	boost::uint32_t          prefetch_window; //!< How far ahead of the read position to request.
+	boost::uint32_t          prefetch_start;  //!< Read position when the window was last adjusted.
+	boost::posix_time::ptime prefetch_time;   //!< Time when the window was last adjusted.
+	bool                     next_prefetched; //!< Whether the next slice has been requested.
 	
 	// Streams
-	util::ifstream ifs; //!< File input stream used when reading from external slices.
-	std::istream * is;  //!< Input stream to read from.
+	int            fd;  //!< File descriptor for positional reads, or \c -1 to use \ref is.
+	util::ifstream ifs; //!< File input stream used if positional reads are not supported.
+	std::istream * is;  //!< Input stream to read from if there is no file descriptor.
+	
+	void init_embedded();
+	bool open_handle(const path_type & file);
+	void close_handle();
+	boost::uint64_t handle_size();
+	
+	/*!
+	 * Read from the current file at \ref position and advance the position.
+	 *
+	 * \return the number of bytes read - this is less than requested only on error or at
+	 *         the end of the file.
+	 */
+	std::streamsize read_at(char * buffer, std::streamsize bytes);
+	
+	//! Restart read-ahead at the current position.
+	void reset_prefetch();
+	
+	//! Request data ahead of the current position if the previous request is running out.
+	void prefetch();
+	
+	//! Request the start of a slice file that has not been opened yet.
+	void prefetch_slice(size_t slice);
 	
 	void seek(size_t slice);
 	bool open_file(const path_type & file);
 	bool open_file_case_insensitive(const path_type & dirname, const path_type & filename);
+	bool open_slice(size_t slice);
 	void open(size_t slice);
 	
 public:
 	
+	//! A byte range in a slice file.
+	struct extent {
+		
+		path_type       file;   //!< The file containing the data.
+		boost::uint64_t offset; //!< Start of the data in the file.
+		boost::uint64_t size;   //!< Number of bytes.
+		
+		extent(const path_type & path, boost::uint64_t start, boost::uint64_t bytes)
+			: file(path), offset(start), size(bytes) { }
+		
+	};
+	
 	static std::string slice_filename(const std::string & basename, size_t slice,
 	                                  size_t slices_per_disk = 1);
 	
@@ -99,6 +217,19 @@ public:
 	 */
 	slice_reader(std::istream * istream, boost::uint32_t offset);
 	
+	/*!
+	 * Construct a \ref slice_reader to read from data inside the setup file.
+	 * Seeking to anything except the zeroeth slice is not allowed.
+	 *
+	 * Unlike the constructor taking a stream, this opens a separate handle for the setup
+	 * file so that multiple readers for the same file can be used independently.
+	 *
+	 * \param file   The setup executable.
+	 * \param offset The offset within the file where the setup data starts.
+	 *               This offset is given by \ref loader::offsets::data_offset.
+	 */
+	slice_reader(const path_type & file, boost::uint32_t offset);
+	
 	/*!
 	 * Construct a \ref slice_reader to read from external data slices (aka disks).
 	 *
@@ -117,6 +248,15 @@ public:
 	slice_reader(const path_type & dirname, const std::string & basename, const std::string & basename2,
 	             size_t disk_slice_count);
 	
+	/*!
+	 * Construct a \ref slice_reader to read from external data slices found in advance.
+	 *
+	 * \param slices The files for all slices. Must outlive the reader.
+	 */
+	explicit slice_reader(const slice_manifest & slices);
+	
+	~slice_reader();
+	
 	/*!
 	 * Attempt to seek to an offset within a slice.
 	 *
@@ -145,11 +285,65 @@ public:
 	 */
 	std::streamsize read(char * buffer, std::streamsize bytes);
 	
+	/*!
+	 * Find where a range of bytes is stored in the slice files.
+	 *
+	 * This allows the data to be accessed without going through this reader.
+	 * Like \ref read(), the range may continue into the following slices.
+	 *
+	 * \param slice  The slice containing the start of the range.
+	 *               Updated to the slice containing the end of the range.
+	 * \param offset The byte offset of the range within that slice.
+	 *               Updated to point to the end of the range.
+	 * \param size   Number of bytes to locate.
+	 * \param result If not \c NULL, receives the file extents making up the range.
+	 *
+	 * \return \c false if the reader was constructed from a stream, or if the range does not
+	 *         start at a valid position - \c true otherwise.
+	 */
+	bool locate(size_t & slice, boost::uint32_t & offset, boost::uint64_t size,
+	            std::vector<extent> * result);
+	
+	/*!
+	 * Find where a range of bytes is stored in the slice files without moving the reader.
+	 *
+	 * Unlike \ref locate(), this does not open or seek in any slice, so it can be used while
+	 * the reader is streaming a chunk. Other slices are found like with \ref find_slice().
+	 *
+	 * \param slice  The slice containing the start of the range.
+	 * \param offset The byte offset of the range within that slice.
+	 * \param size   Number of bytes to locate.
+	 * \param result Receives the file extents making up the range.
+	 *
+	 * \return \c false if the extents could not be determined - \c true otherwise.
+	 */
+	bool find_extents(size_t slice, boost::uint32_t offset, boost::uint64_t size,
+	                  std::vector<extent> & result) const;
+	
+	/*!
+	 * Find the file containing a slice without opening it.
+	 *
+	 * Unlike opening the slice, this does not search the directory for files with
+	 * differently-cased names.
+	 *
+	 * \return the path of the file or an empty path if it could not be found.
+	 */
+	path_type find_slice(size_t slice) const;
+	
+	/*!
+	 * Check that a slice file exists and has a valid header.
+	 *
+	 * Unlike \ref seek() this does not log anything and leaves no slice open.
+	 *
+	 * \throws slice_error if the slice could not be opened or is invalid.
+	 */
+	void check(size_t slice);
+	
 	//! \return the number currently opened slice.
 	size_t slice() { return current_slice; }
 	
 	//! \return true a slice is currently open.
-	bool is_open() { return (is != &ifs || ifs.is_open()); }
+	bool is_open() { return (fd >= 0 || is != &ifs || ifs.is_open()); }
 	
 };
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "util/cache.hpp"
+
+#include <limits>
+
+#include "configure.hpp"
+
+#if INNOEXTRACT_HAVE_POSIX_FADVISE
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace util {
+
+namespace {
+
+//! Amount of written data passed to the disk at once.
+const boost::uint64_t window_size = 16 * 1024 * 1024;
+
+#if INNOEXTRACT_HAVE_POSIX_FADVISE
+
+//! \return true if the given range can be represented by \c off_t.
+bool fits(boost::uint64_t offset, boost::uint64_t size) {
+	boost::uint64_t max = boost::uint64_t(std::numeric_limits<off_t>::max());
+	return offset <= max && size <= max - offset;
+}
+
+#endif
+
+} // anonymous namespace
+
+void drop_cache(const boost::filesystem::path & file, boost::uint64_t offset, boost::uint64_t size) {
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE
+	
+	if(size == 0 || !fits(offset, size)) {
+		return;
+	}
+	
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return;
+	}
+	
+	(void)::posix_fadvise(fd, off_t(offset), off_t(size), POSIX_FADV_DONTNEED);
+	
+	::close(fd);
+	
+	#else
+	
+	(void)file, (void)offset, (void)size;
+	
+	#endif
+}
+
+write_cache_limiter::write_cache_limiter() : fd(-1), started(0), dropped(0) { }
+
+write_cache_limiter::~write_cache_limiter() {
+	close();
+}
+
+void write_cache_limiter::open(const boost::filesystem::path & file) {
+	
+	close();
+	
+	started = dropped = 0;
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE && INNOEXTRACT_HAVE_SYNC_FILE_RANGE
+	fd = ::open(file.c_str(), O_RDONLY);
+	#else
+	(void)file;
+	#endif
+}
+
+bool write_cache_limiter::is_due(boost::uint64_t end) const {
+	return fd >= 0 && end >= started + window_size;
+}
+
+void write_cache_limiter::written(boost::uint64_t end) {
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE && INNOEXTRACT_HAVE_SYNC_FILE_RANGE
+	
+	if(fd < 0 || end <= started || !fits(started, end - started)) {
+		return;
+	}
+	
+	// Start writing the new data without waiting for it
+	(void)::sync_file_range(fd, off_t(started), off_t(end - started), SYNC_FILE_RANGE_WRITE);
+	
+	// Wait for the previous window, which should be done by now, and release it
+	if(started > dropped) {
+		unsigned flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+		(void)::sync_file_range(fd, off_t(dropped), off_t(started - dropped), flags);
+		(void)::posix_fadvise(fd, off_t(dropped), off_t(started - dropped), POSIX_FADV_DONTNEED);
+		dropped = started;
+	}
+	
+	started = end;
+	
+	#else
+	
+	(void)end;
+	
+	#endif
+}
+
+void write_cache_limiter::close() {
+	
+	#if INNOEXTRACT_HAVE_POSIX_FADVISE && INNOEXTRACT_HAVE_SYNC_FILE_RANGE
+	
+	if(fd < 0) {
+		return;
+	}
+	
+	/*
+	 * Don't wait for the rest of the file to be written: with many small files this would
+	 * serialize the extraction with the disk. Pages that are still dirty stay cached.
+	 */
+	(void)::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+	(void)::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	
+	::close(fd);
+	
+	#endif
+	
+	fd = -1;
+}
+
+} // namespace util
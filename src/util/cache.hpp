@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Keeping large reads and writes from filling up the page cache.
+ */
+#ifndef INNOEXTRACT_UTIL_CACHE_HPP
+#define INNOEXTRACT_UTIL_CACHE_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace util {
+
+/*!
+ * Tell the system that a range of a file will not be read again.
+ *
+ * Cached pages for the range are released unless they still need to be written.
+ * Errors and missing support by the platform are ignored.
+ */
+void drop_cache(const boost::filesystem::path & file, boost::uint64_t offset, boost::uint64_t size);
+
+/*!
+ * Limits the amount of page cache used by data written to a file.
+ *
+ * Written data is passed to the disk in windows of a fixed size. Once a window has been
+ * written, it is released from the cache. This keeps at most two windows of the file in
+ * memory instead of letting the whole file accumulate. Only sequential writes are handled,
+ * anything else is released when the limiter is closed.
+ *
+ * Where the platform does not support this, the limiter does nothing.
+ */
+class write_cache_limiter : private boost::noncopyable {
+	
+	int fd;
+	
+	boost::uint64_t started; //!< End of the range that is being written.
+	boost::uint64_t dropped; //!< End of the range that has been released.
+	
+public:
+	
+	write_cache_limiter();
+	~write_cache_limiter();
+	
+	/*!
+	 * Start limiting the cache used by a file.
+	 *
+	 * The file must already exist. It can be written to using any handle.
+	 */
+	void open(const boost::filesystem::path & file);
+	
+	/*!
+	 * \return \c true if enough data has been written that \ref written() should be called.
+	 *
+	 * \param end The end of the data written so far.
+	 */
+	bool is_due(boost::uint64_t end) const;
+	
+	/*!
+	 * Write out the data and release the previous window from the cache.
+	 *
+	 * Buffered data must have been passed to the system before calling this function.
+	 *
+	 * \param end The end of the data written so far.
+	 */
+	void written(boost::uint64_t end);
+	
+	/*!
+	 * Start writing out the remaining data and release whatever is no longer needed.
+	 *
+	 * Buffered data must have been passed to the system before calling this function.
+	 */
+	void close();
+	
+};
+
+} // namespace util
+
+#endif // INNOEXTRACT_UTIL_CACHE_HPP
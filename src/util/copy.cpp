@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "util/copy.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "configure.hpp"
+
+#if INNOEXTRACT_HAVE_PREAD
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if INNOEXTRACT_HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#if INNOEXTRACT_HAVE_FICLONE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include <boost/filesystem/operations.hpp>
+
+#include "util/fstream.hpp"
+
+namespace util {
+
+namespace {
+
+//! Amount of source data mapped or read at once.
+const size_t window_size = 8 * 1024 * 1024;
+
+#if INNOEXTRACT_HAVE_PREAD
+
+//! \return true if the given range can be represented by the \c Offset type.
+template <typename Offset>
+bool fits(boost::uint64_t offset, size_t size) {
+	return offset + size <= boost::uint64_t(std::numeric_limits<Offset>::max());
+}
+
+#if INNOEXTRACT_HAVE_COPY_FILE_RANGE
+
+/*!
+ * Call \c copy_file_range() with offsets of whatever type the system uses.
+ *
+ * \return the number of bytes copied, \c 0 if \c copy_file_range() is not usable for these
+ *         files or \c -1 on other errors.
+ */
+template <typename Offset>
+ssize_t kernel_copy(ssize_t (*function)(int, Offset *, int, Offset *, size_t, unsigned int),
+                    int in, boost::uint64_t in_offset, int out, boost::uint64_t out_offset,
+                    size_t size) {
+	
+	if(!fits<Offset>(in_offset, size) || !fits<Offset>(out_offset, size)) {
+		return 0;
+	}
+	
+	Offset in_pos = Offset(in_offset), out_pos = Offset(out_offset);
+	ssize_t result;
+	do {
+		result = function(in, &in_pos, out, &out_pos, size, 0);
+	} while(result < 0 && errno == EINTR);
+	
+	if(result < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP
+	                  || errno == EBADF)) {
+		return 0;
+	}
+	
+	return result;
+}
+
+#endif // INNOEXTRACT_HAVE_COPY_FILE_RANGE
+
+#if INNOEXTRACT_HAVE_SENDFILE
+
+//! Call \c sendfile() with offsets of whatever type the system uses.
+template <typename Offset>
+ssize_t kernel_send(ssize_t (*function)(int, int, Offset *, size_t),
+                    int in, boost::uint64_t in_offset, int out, boost::uint64_t out_offset,
+                    size_t size) {
+	
+	if(!fits<Offset>(in_offset, size) || !fits<off_t>(out_offset, size)) {
+		return 0;
+	}
+	
+	if(lseek(out, off_t(out_offset), SEEK_SET) == off_t(-1)) {
+		return -1;
+	}
+	
+	Offset in_pos = Offset(in_offset);
+	ssize_t result;
+	do {
+		result = function(out, in, &in_pos, size);
+	} while(result < 0 && errno == EINTR);
+	
+	if(result < 0 && (errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+		return 0;
+	}
+	
+	return result;
+}
+
+#endif // INNOEXTRACT_HAVE_SENDFILE
+
+#endif // INNOEXTRACT_HAVE_PREAD
+
+} // anonymous namespace
+
+file_copier::file_copier()
+	: source(-1)
+	, use_copy_file_range(true)
+	, use_sendfile(true)
+{ }
+
+file_copier::~file_copier() {
+	close_source();
+}
+
+void file_copier::close_source() {
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	if(source >= 0) {
+		::close(source);
+	}
+	#endif
+	
+	source = -1;
+	source_path.clear();
+}
+
+bool file_copier::open_source(const boost::filesystem::path & file) {
+	
+	if(source >= 0 && file == source_path) {
+		return true;
+	}
+	
+	close_source();
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	
+	source = ::open(file.c_str(), O_RDONLY);
+	if(source < 0) {
+		return false;
+	}
+	
+	source_path = file;
+	
+	return true;
+	
+	#else
+	
+	return false;
+	
+	#endif
+}
+
+#if INNOEXTRACT_HAVE_PREAD
+
+const char * file_copier::read(boost::uint64_t offset, size_t size) {
+	
+	if(!fits<off_t>(offset, size)) {
+		return NULL;
+	}
+	
+	buffer.resize(std::max(buffer.size(), size));
+	
+	size_t done = 0;
+	while(done < size) {
+		ssize_t result = ::pread(source, &buffer[done], size - done, off_t(offset + done));
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result <= 0) {
+			return NULL;
+		}
+		done += size_t(result);
+	}
+	
+	return &buffer[0];
+}
+
+bool file_copier::write(boost::uint64_t offset, size_t size, int fd, boost::uint64_t target_offset,
+                        const char * data) {
+	
+	size_t done = 0;
+	
+	#if INNOEXTRACT_HAVE_COPY_FILE_RANGE
+	while(use_copy_file_range && done < size) {
+		ssize_t result = kernel_copy(::copy_file_range, source, offset + done, fd,
+		                             target_offset + done, size - done);
+		if(result < 0) {
+			return false;
+		} else if(result == 0) {
+			use_copy_file_range = (done != 0);
+			break;
+		}
+		done += size_t(result);
+	}
+	#endif
+	
+	#if INNOEXTRACT_HAVE_SENDFILE
+	while(use_sendfile && done < size) {
+		ssize_t result = kernel_send(::sendfile, source, offset + done, fd,
+		                             target_offset + done, size - done);
+		if(result < 0) {
+			return false;
+		} else if(result == 0) {
+			use_sendfile = (done != 0);
+			break;
+		}
+		done += size_t(result);
+	}
+	#endif
+	
+	if(done == size) {
+		return true;
+	}
+	
+	if(!data) {
+		data = read(offset, size);
+		if(!data) {
+			return false;
+		}
+	}
+	
+	if(!fits<off_t>(target_offset, size)) {
+		return false;
+	}
+	
+	while(done < size) {
+		ssize_t result = ::pwrite(fd, data + done, size - done, off_t(target_offset + done));
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result <= 0) {
+			return false;
+		}
+		done += size_t(result);
+	}
+	
+	return true;
+}
+
+#endif // INNOEXTRACT_HAVE_PREAD
+
+bool file_copier::copy(boost::uint64_t offset, boost::uint64_t size, std::vector<target> & targets,
+                       observer * sink) {
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	
+	if(source < 0) {
+		return false;
+	}
+	
+	std::vector<int> fds;
+	fds.reserve(targets.size());
+	bool success = true;
+	for(size_t i = 0; i < targets.size() && success; i++) {
+		int fd = ::open(targets[i].file.c_str(), O_WRONLY);
+		if(fd < 0) {
+			success = false;
+		} else {
+			fds.push_back(fd);
+		}
+	}
+	
+	while(success && size > 0) {
+		
+		size_t n = size_t(std::min(size, boost::uint64_t(window_size)));
+		
+		// The data is read with pread() and not mapped: a mapping of a slice file that is
+		// truncated while we are copying from it would raise SIGBUS.
+		const char * data = NULL;
+		if(sink) {
+			data = read(offset, n);
+			success = (data != NULL);
+		}
+		
+		if(success && sink) {
+			sink->update(data, n);
+		}
+		
+		for(size_t i = 0; i < targets.size() && success; i++) {
+			success = write(offset, n, fds[i], targets[i].offset, data);
+			targets[i].offset += n;
+		}
+		
+		offset += n, size -= n;
+	}
+	
+	for(size_t i = 0; i < fds.size(); i++) {
+		if(::close(fds[i]) != 0) {
+			success = false;
+		}
+	}
+	
+	return success;
+	
+	#else
+	
+	(void)offset, (void)size, (void)targets, (void)sink;
+	
+	return false;
+	
+	#endif
+}
+
+bool clone_file(const boost::filesystem::path & source, const boost::filesystem::path & target,
+                clone_method method) {
+	
+	boost::system::error_code ec;
+	boost::uint64_t size = boost::filesystem::file_size(source, ec);
+	if(ec) {
+		return false;
+	}
+	
+	boost::filesystem::remove(target, ec);
+	
+	if(method == CloneHardlink) {
+		boost::filesystem::create_hard_link(source, target, ec);
+		if(!ec) {
+			return true;
+		}
+	}
+	
+	#if INNOEXTRACT_HAVE_PREAD
+	
+	int out = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(out < 0) {
+		return false;
+	}
+	
+	#if INNOEXTRACT_HAVE_FICLONE
+	if(method == CloneReflink) {
+		int in = ::open(source.c_str(), O_RDONLY);
+		bool cloned = (in >= 0 && ioctl(out, FICLONE, in) == 0);
+		if(in >= 0) {
+			::close(in);
+		}
+		if(cloned) {
+			return (::close(out) == 0);
+		}
+	}
+	#endif
+	
+	::close(out);
+	
+	file_copier copier;
+	std::vector<file_copier::target> targets(1, file_copier::target(target, 0));
+	return copier.open_source(source) && copier.copy(0, size, targets, NULL);
+	
+	#else
+	
+	util::ifstream ifs(source, std::ios_base::in | std::ios_base::binary);
+	util::ofstream ofs(target, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if(!ifs.is_open() || !ofs.is_open()) {
+		return false;
+	}
+	
+	std::vector<char> buffer(window_size);
+	while(size > 0) {
+		std::streamsize n = std::streamsize(std::min(size, boost::uint64_t(buffer.size())));
+		if(ifs.read(&buffer[0], n).fail() || ofs.write(&buffer[0], n).fail()) {
+			return false;
+		}
+		size -= boost::uint64_t(n);
+	}
+	
+	ofs.close();
+	
+	return !ofs.fail();
+	
+	#endif
+}
+
+} // namespace util
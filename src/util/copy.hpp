@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Copying byte ranges between files without passing the data through user-space buffers.
+ */
+#ifndef INNOEXTRACT_UTIL_COPY_HPP
+#define INNOEXTRACT_UTIL_COPY_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace util {
+
+/*!
+ * Copies byte ranges from a source file into one or more target files.
+ *
+ * Where supported, the data is moved by the kernel using \c copy_file_range() or
+ * \c sendfile(). The copied data is also passed to an \ref observer so that checksums can
+ * be calculated - it is read with \c pread() and reused for targets the kernel can't
+ * copy to.
+ *
+ * On platforms without the required functions \ref open_source() always fails and the
+ * caller should fall back to regular stream I/O.
+ */
+class file_copier : private boost::noncopyable {
+	
+public:
+	
+	//! Receives the copied data in order.
+	class observer {
+		
+	public:
+		
+		virtual ~observer() { }
+		
+		virtual void update(const char * data, size_t size) = 0;
+		
+	};
+	
+	//! A location in a target file.
+	struct target {
+		
+		boost::filesystem::path file;
+		boost::uint64_t offset;
+		
+		target(const boost::filesystem::path & path, boost::uint64_t position)
+			: file(path), offset(position) { }
+		
+	};
+	
+	file_copier();
+	~file_copier();
+	
+	/*!
+	 * Select the file to copy from.
+	 *
+	 * The file is kept open between calls with the same path.
+	 *
+	 * \return \c false if the file could not be opened or if direct copying is not
+	 *         supported on this platform.
+	 */
+	bool open_source(const boost::filesystem::path & file);
+	
+	/*!
+	 * Copy a byte range from the current source file to all targets.
+	 *
+	 * The target files must already exist and are not truncated. Target offsets are
+	 * advanced by the number of bytes copied.
+	 *
+	 * \param offset   Start of the range in the source file.
+	 * \param size     Number of bytes to copy.
+	 * \param targets  Locations to copy the data to.
+	 * \param sink     Receives all copied data if not \c NULL.
+	 *
+	 * \return \c false if there was an error. In that case the targets and sink may
+	 *         have received part of the data.
+	 */
+	bool copy(boost::uint64_t offset, boost::uint64_t size, std::vector<target> & targets,
+	          observer * sink);
+	
+private:
+	
+	boost::filesystem::path source_path;
+	int source;
+	
+	bool use_copy_file_range; //!< Cleared if copy_file_range() is not supported.
+	bool use_sendfile;        //!< Cleared if sendfile() is not supported.
+	
+	std::vector<char> buffer;
+	
+	void close_source();
+	
+	//! Read part of the source file into the buffer.
+	const char * read(boost::uint64_t offset, size_t size);
+	
+	//! Copy part of the source file to one target, using the given data if the kernel can't.
+	bool write(boost::uint64_t offset, size_t size, int fd, boost::uint64_t target_offset,
+	           const char * data);
+	
+};
+
+//! How \ref clone_file() creates the new file.
+enum clone_method {
+	CloneCopy,     //!< Copy the data.
+	CloneReflink,  //!< Share the data blocks if supported by the file system, copy otherwise.
+	CloneHardlink  //!< Create a hard link if possible, copy otherwise.
+};
+
+/*!
+ * Create a file with the same contents as an existing one.
+ *
+ * An existing file at the target path is replaced.
+ *
+ * \return \c false if the file could not be created.
+ */
+bool clone_file(const boost::filesystem::path & source, const boost::filesystem::path & target,
+                clone_method method);
+
+} // namespace util
+
+#endif // INNOEXTRACT_UTIL_COPY_HPP
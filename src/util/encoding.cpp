@@ -75,6 +75,7 @@
 
 #include "util/log.hpp"
 #include "util/math.hpp"
+#include "util/thread.hpp"
 
 namespace util {
 
@@ -599,6 +600,9 @@ void utf8_to_windows1252(const std::string & from, std::string & to) {
 typedef boost::unordered_map<codepage_id, iconv_t> converter_map;
 converter_map converters;
 
+//! Protects \ref converters and the iconv handles, which may not be used concurrently.
+util::mutex converters_mutex;
+
 iconv_t get_converter(codepage_id codepage, bool reverse) {
 	
 	boost::uint32_t key = codepage | (reverse ? 0x80000000 : 0);
@@ -638,6 +642,8 @@ iconv_t get_converter(codepage_id codepage, bool reverse) {
 
 bool utf8_iconv(const std::string & from, std::string & to, codepage_id codepage, bool reverse) {
 	
+	util::scoped_lock<util::mutex> lock(converters_mutex);
+	
 	iconv_t converter = get_converter(codepage, reverse);
 	if(converter == iconv_t(-1)) {
 		return false;
@@ -22,6 +22,13 @@
 
 #include <iostream>
 
+#include "configure.hpp"
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+#include <map>
+#include <thread>
+#endif
+
 #include "util/console.hpp"
 
 bool logger::debug = false;
@@ -30,8 +37,88 @@ bool logger::quiet = false;
 size_t logger::total_errors = 0;
 size_t logger::total_warnings = 0;
 
+util::recursive_mutex logger::output_mutex;
+
+namespace {
+
+//! Protects the capture registry and writes to captured output buffers.
+util::mutex capture_mutex;
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+typedef std::map<std::thread::id, output_capture *> capture_map;
+capture_map captures;
+#else
+output_capture * capture = NULL;
+#endif
+
+output_capture * find_capture() {
+	#if INNOEXTRACT_HAVE_STD_THREAD
+	capture_map::const_iterator it = captures.find(std::this_thread::get_id());
+	return it == captures.end() ? NULL : it->second;
+	#else
+	return capture;
+	#endif
+}
+
+void set_capture(output_capture * new_capture) {
+	#if INNOEXTRACT_HAVE_STD_THREAD
+	if(new_capture) {
+		captures[std::this_thread::get_id()] = new_capture;
+	} else {
+		captures.erase(std::this_thread::get_id());
+	}
+	#else
+	capture = new_capture;
+	#endif
+}
+
+std::streambuf * console_out = NULL;
+std::streambuf * console_err = NULL;
+
+//! Stream buffer that forwards writes to the current thread's capture or to the console.
+class capture_streambuf : public std::streambuf {
+	
+	std::streambuf * const console;
+	std::streambuf * output_capture::* const target;
+	
+	std::streambuf * get() {
+		output_capture * current = find_capture();
+		return current ? current->*target : console;
+	}
+	
+public:
+	
+	capture_streambuf(std::streambuf * console_buf, std::streambuf * output_capture::* member)
+		: console(console_buf), target(member) { }
+	
+protected:
+	
+	int_type overflow(int_type c) {
+		if(traits_type::eq_int_type(c, traits_type::eof())) {
+			return traits_type::not_eof(c);
+		}
+		util::scoped_lock<util::mutex> lock(capture_mutex);
+		return get()->sputc(traits_type::to_char_type(c));
+	}
+	
+	std::streamsize xsputn(const char * s, std::streamsize n) {
+		util::scoped_lock<util::mutex> lock(capture_mutex);
+		return get()->sputn(s, n);
+	}
+	
+	int sync() {
+		util::scoped_lock<util::mutex> lock(capture_mutex);
+		return get()->pubsync();
+	}
+	
+};
+
+} // anonymous namespace
+
 logger::~logger() {
 	
+	util::scoped_lock<util::recursive_mutex> lock(output_mutex);
+	
 	color::shell_command previous = color::current;
 	progress::clear();
 	
@@ -40,25 +127,100 @@ logger::~logger() {
 		case Info:    std::cout << color::white  << buffer.str() << previous << "\n"; break;
 		case Warning: {
 			std::cerr << color::yellow << "Warning: " << buffer.str() << previous << "\n";
-			total_warnings++;
+			warning_count()++;
 			break;
 		}
 		case Error: {
 			std::cerr << color::red << buffer.str() << previous << "\n";
-			total_errors++;
+			error_count()++;
 			break;
 		}
 	}
 	
 }
 
+output_capture::scope::scope(output_capture * capture) {
+	util::scoped_lock<util::mutex> lock(capture_mutex);
+	previous = find_capture();
+	set_capture(capture);
+}
+
+output_capture::scope::~scope() {
+	util::scoped_lock<util::mutex> lock(capture_mutex);
+	set_capture(previous);
+}
+
+void output_capture::flush() {
+	
+	util::scoped_lock<util::recursive_mutex> lock(logger::output_mutex);
+	
+	std::string out_data = out_buffer.str();
+	std::string err_data = err_buffer.str();
+	out_buffer.str(std::string());
+	err_buffer.str(std::string());
+	
+	std::streambuf * out_console = console_out ? console_out : std::cout.rdbuf();
+	std::streambuf * err_console = console_err ? console_err : std::cerr.rdbuf();
+	out_console->sputn(out_data.data(), std::streamsize(out_data.size()));
+	out_console->pubsync();
+	err_console->sputn(err_data.data(), std::streamsize(err_data.size()));
+	err_console->pubsync();
+	
+	logger::total_warnings += warnings;
+	logger::total_errors += errors;
+	warnings = 0;
+	errors = 0;
+	
+}
+
+output_capture * output_capture::current() {
+	util::scoped_lock<util::mutex> lock(capture_mutex);
+	return find_capture();
+}
+
+void output_capture::install() {
+	
+	if(console_out) {
+		return;
+	}
+	
+	std::cout.flush();
+	std::cerr.flush();
+	
+	console_out = std::cout.rdbuf();
+	console_err = std::cerr.rdbuf();
+	
+	static capture_streambuf out(console_out, &output_capture::out);
+	static capture_streambuf err(console_err, &output_capture::err);
+	
+	std::cout.rdbuf(&out);
+	std::cerr.rdbuf(&err);
+	
+}
+
 std::streambuf * warning_suppressor::set_streambuf(std::streambuf * streambuf) {
+	if(output_capture * capture = output_capture::current()) {
+		util::scoped_lock<util::mutex> lock(capture_mutex);
+		std::streambuf * old = capture->err;
+		capture->err = streambuf;
+		return old;
+	}
 	return std::cerr.rdbuf(streambuf);
 }
 
+size_t & logger::warning_count() {
+	output_capture * capture = output_capture::current();
+	return capture ? capture->warnings : logger::total_warnings;
+}
+
+size_t & logger::error_count() {
+	output_capture * capture = output_capture::current();
+	return capture ? capture->errors : logger::total_errors;
+}
+
 void warning_suppressor::flush() {
 	restore();
 	std::cerr << buffer.str();
-	logger::total_warnings += warnings;
-	logger::total_errors += errors;
+	logger::warning_count() += warnings;
+	logger::error_count() += errors;
 }
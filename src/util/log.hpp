@@ -31,6 +31,8 @@
 
 #include <boost/noncopyable.hpp>
 
+#include "util/thread.hpp"
+
 #ifdef DEBUG
 #define debug(...) \
 	if(::logger::debug) \
@@ -73,6 +75,23 @@ public:
 	static bool debug; //! Is \ref debug output enabled?
 	static bool quiet; //! Is \ref log_info disabled?
 	
+	/*!
+	 * Lock serializing console output between threads.
+	 *
+	 * This is held while writing log messages. Code that writes to \c std::cout or updates
+	 * the progress bar from worker threads must also hold it.
+	 */
+	static util::recursive_mutex output_mutex;
+	
+	/*!
+	 * \return the warning counter for the current thread: the counter of the
+	 *         \ref output_capture it is redirected to or \ref total_warnings.
+	 */
+	static size_t & warning_count();
+	
+	//! \return the error counter for the current thread, see \ref warning_count().
+	static size_t & error_count();
+	
 	/*!
 	 * Construct a log line output stream.
 	 *
@@ -91,6 +110,66 @@ public:
 	
 };
 
+/*!
+ * Buffer for the console output and log statistics of one task.
+ *
+ * Threads whose output is redirected to a capture using \ref scope write to its buffers
+ * instead of to \c std::cout and \c std::cerr, and their \ref log_warning and
+ * \ref log_error uses are only counted in the capture until it is flushed. This is used
+ * to process multiple installers concurrently without mixing their output.
+ *
+ * \ref install() must be called before captured output can be separated.
+ */
+class output_capture : private boost::noncopyable {
+	
+	std::ostringstream out_buffer;
+	std::ostringstream err_buffer;
+	
+public:
+	
+	std::streambuf * out; //!< Target for std::cout writes by redirected threads.
+	std::streambuf * err; //!< Target for std::cerr writes by redirected threads.
+	
+	size_t warnings; //!< Number of \ref log_warning uses while redirected.
+	size_t errors;   //!< Number of \ref log_error uses while redirected.
+	
+	//! Redirect the output of the current thread to a capture until destroyed.
+	class scope : private boost::noncopyable {
+		
+		output_capture * previous;
+		
+	public:
+		
+		/*!
+		 * \param capture The capture to write to or \c NULL to write to the console.
+		 */
+		explicit scope(output_capture * capture);
+		
+		~scope();
+		
+	};
+	
+	output_capture()
+		: out(out_buffer.rdbuf()), err(err_buffer.rdbuf())
+		, warnings(0), errors(0)
+	{ }
+	
+	/*!
+	 * Write the captured output to the console and add the captured warning and error
+	 * counts to \ref logger::total_warnings and \ref logger::total_errors.
+	 *
+	 * Must not be called while any threads are still redirected to this capture.
+	 */
+	void flush();
+	
+	//! \return the capture the current thread is redirected to or \c NULL
+	static output_capture * current();
+	
+	//! Route \c std::cout and \c std::cerr writes through the current thread's capture.
+	static void install();
+	
+};
+
 class warning_storage {
 	
 protected:
@@ -113,8 +192,8 @@ public:
 	
 	warning_suppressor()
 		: streambuf(set_streambuf(buffer.rdbuf()))
-		, warnings(logger::total_warnings)
-		, errors(logger::total_errors)
+		, warnings(logger::warning_count())
+		, errors(logger::error_count())
 	{ }
 	
 	~warning_suppressor() {
@@ -130,10 +209,10 @@ public:
 		set_streambuf(streambuf);
 		streambuf = NULL;
 		
-		size_t new_warnings = logger::total_warnings - warnings;
-		size_t new_errors = logger::total_errors - errors;
-		logger::total_warnings = warnings;
-		logger::total_errors = errors;
+		size_t new_warnings = logger::warning_count() - warnings;
+		size_t new_errors = logger::error_count() - errors;
+		logger::warning_count() = warnings;
+		logger::error_count() = errors;
 		warnings = new_warnings;
 		errors = new_errors;
 		
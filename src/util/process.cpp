@@ -52,10 +52,6 @@ extern char ** environ;
 #endif
 #endif
 
-#if INNOEXTRACT_HAVE_UNISTD_ENVIRON || (INNOEXTRACT_HAVE_FORK && INNOEXTRACT_HAVE_EXECVP)
-#include <unistd.h>
-#endif
-
 #if INNOEXTRACT_HAVE_WAITPID
 #include <sys/wait.h>
 #endif
@@ -66,6 +62,10 @@ extern char ** environ;
 
 #endif
 
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
 #include "util/encoding.hpp"
 
 namespace util {
@@ -186,4 +186,12 @@ int run(const char * const args[]) {
 	
 }
 
+boost::uint32_t process_id() {
+#if defined(_WIN32)
+	return boost::uint32_t(GetCurrentProcessId());
+#else
+	return boost::uint32_t(getpid());
+#endif
+}
+
 } // namespace util
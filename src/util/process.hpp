@@ -23,6 +23,8 @@
 
 #include <string>
 
+#include <boost/cstdint.hpp>
+
 namespace util {
 
 /*!
@@ -37,6 +39,9 @@ namespace util {
  */
 int run(const char * const args[]);
 
+//! \return an identifier for the current process, unique among running processes.
+boost::uint32_t process_id();
+
 } // namespace util
 
 #endif // INNOEXTRACT_UTIL_PROCESS_HPP
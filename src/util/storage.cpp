@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "util/storage.hpp"
+
+#include <limits>
+
+#include "configure.hpp"
+
+#if INNOEXTRACT_HAVE_FALLOCATE && INNOEXTRACT_HAVE_FALLOC_FL_KEEP_SIZE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if INNOEXTRACT_HAVE_STAT
+#include <sys/stat.h>
+#endif
+
+namespace util {
+
+bool preallocate(const boost::filesystem::path & file, boost::uint64_t size) {
+	
+	#if INNOEXTRACT_HAVE_FALLOCATE && INNOEXTRACT_HAVE_FALLOC_FL_KEEP_SIZE
+	
+	if(size == 0 || size > boost::uint64_t(std::numeric_limits<off_t>::max())) {
+		return true;
+	}
+	
+	int fd = ::open(file.c_str(), O_WRONLY);
+	if(fd < 0) {
+		return true;
+	}
+	
+	// posix_fallocate() is not used as it extends the file: an interrupted extraction
+	// would leave files that already have their final size.
+	int error;
+	do {
+		error = (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, off_t(size)) == 0) ? 0 : errno;
+	} while(error == EINTR);
+	
+	::close(fd);
+	
+	return (error != ENOSPC && error != EFBIG);
+	
+	#else
+	
+	(void)file, (void)size;
+	
+	return true;
+	
+	#endif
+}
+
+boost::uint64_t device_id(const boost::filesystem::path & file) {
+	
+	#if INNOEXTRACT_HAVE_STAT
+	
+	struct stat info;
+	if(::stat(file.c_str(), &info) != 0) {
+		return 0;
+	}
+	
+	// Device 0 is valid but rare, make sure it can be told apart from errors
+	return boost::uint64_t(info.st_dev) + 1;
+	
+	#else
+	
+	(void)file;
+	
+	return 0;
+	
+	#endif
+}
+
+bool make_read_only(const boost::filesystem::path & file) {
+	
+	#if INNOEXTRACT_HAVE_STAT
+	
+	struct stat info;
+	if(::stat(file.c_str(), &info) != 0) {
+		return false;
+	}
+	
+	return ::chmod(file.c_str(), info.st_mode & ~mode_t(S_IWUSR | S_IWGRP | S_IWOTH)) == 0;
+	
+	#else
+	
+	(void)file;
+	
+	return false;
+	
+	#endif
+}
+
+} // namespace util
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Functions for managing the disk space used by output files, finding where files are stored
+ * and protecting them.
+ */
+#ifndef INNOEXTRACT_UTIL_STORAGE_HPP
+#define INNOEXTRACT_UTIL_STORAGE_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace util {
+
+/*!
+ * Reserve disk space for a file that will be written later.
+ *
+ * This lets the file system allocate the file in one piece instead of growing it with each
+ * write. The apparent file size is not changed so that incompletely written files can
+ * still be recognized - platforms that can only preallocate by extending the file are
+ * treated as not supporting preallocation.
+ *
+ * \param file The file to allocate space for. Must already exist.
+ * \param size The final size of the file.
+ *
+ * \return \c false if there is not enough space for the file. Other errors, including
+ *         missing support for preallocation by the platform or file system, are ignored.
+ */
+bool preallocate(const boost::filesystem::path & file, boost::uint64_t size);
+
+/*!
+ * Identify the device a file is stored on.
+ *
+ * Files on the same disk or network share return the same identifier.
+ *
+ * \return the device identifier or \c 0 if it could not be determined.
+ */
+boost::uint64_t device_id(const boost::filesystem::path & file);
+
+/*!
+ * Remove write permissions from a file.
+ *
+ * \return \c false if the permissions could not be changed or if this is not supported
+ *         on this platform.
+ */
+bool make_read_only(const boost::filesystem::path & file);
+
+} // namespace util
+
+#endif // INNOEXTRACT_UTIL_STORAGE_HPP
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "util/thread.hpp"
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+#include <exception>
+#include <thread>
+#include <vector>
+#endif
+
+namespace util {
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+
+namespace {
+
+class thread_result {
+	
+	runnable & task_;
+	
+	std::exception_ptr & error_;
+	mutex & error_mutex_;
+	
+public:
+	
+	thread_result(runnable & task, std::exception_ptr & error, mutex & error_mutex)
+		: task_(task), error_(error), error_mutex_(error_mutex) { }
+	
+	void operator()() {
+		try {
+			task_.run();
+		} catch(...) {
+			scoped_lock<mutex> lock(error_mutex_);
+			if(!error_) {
+				error_ = std::current_exception();
+			}
+		}
+	}
+	
+};
+
+} // anonymous namespace
+
+void run_threads(runnable & task, size_t count) {
+	
+	std::exception_ptr error;
+	mutex error_mutex;
+	thread_result worker(task, error, error_mutex);
+	
+	std::vector<std::thread> threads;
+	threads.reserve(count > 1 ? count - 1 : 0);
+	try {
+		for(size_t i = 1; i < count; i++) {
+			threads.push_back(std::thread(worker));
+		}
+	} catch(...) {
+		// Could not create all threads - continue with the ones we have
+	}
+	
+	worker();
+	
+	for(size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	
+	if(error) {
+		std::rethrow_exception(error);
+	}
+	
+}
+
+size_t hardware_concurrency() {
+	unsigned count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : size_t(count);
+}
+
+#else
+
+void run_threads(runnable & task, size_t count) {
+	(void)count;
+	task.run();
+}
+
+size_t hardware_concurrency() {
+	return 1;
+}
+
+#endif
+
+} // namespace util
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2026 Daniel Scharrer
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the author(s) be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/*!
+ * \file
+ *
+ * Minimal threading primitives that degrade to single-threaded no-ops if
+ * std::thread is not available.
+ */
+#ifndef INNOEXTRACT_UTIL_THREAD_HPP
+#define INNOEXTRACT_UTIL_THREAD_HPP
+
+#include <stddef.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "configure.hpp"
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+#include <mutex>
+#endif
+
+namespace util {
+
+#if INNOEXTRACT_HAVE_STD_THREAD
+
+typedef std::mutex mutex;
+typedef std::recursive_mutex recursive_mutex;
+
+#else
+
+//! Dummy mutex used when there is no thread support.
+class mutex : private boost::noncopyable {
+	
+public:
+	
+	void lock() { }
+	void unlock() { }
+	
+};
+
+typedef mutex recursive_mutex;
+
+#endif
+
+//! Hold a lock on a mutex for the lifetime of this object.
+template <typename Mutex>
+class scoped_lock : private boost::noncopyable {
+	
+	Mutex & mutex_;
+	
+public:
+	
+	explicit scoped_lock(Mutex & lockable) : mutex_(lockable) {
+		mutex_.lock();
+	}
+	
+	~scoped_lock() {
+		mutex_.unlock();
+	}
+	
+};
+
+//! A task that can be run concurrently by \ref run_threads.
+class runnable {
+	
+public:
+	
+	virtual ~runnable() { }
+	
+	//! Called once on each thread - must be safe to run concurrently with itself.
+	virtual void run() = 0;
+	
+};
+
+/*!
+ * Run a task concurrently on multiple threads and wait until all of them are done.
+ *
+ * The calling thread is used as one of the workers.
+ * If the task exits with an exception on any thread, the first such exception is
+ * re-thrown after all threads have finished.
+ *
+ * \param task  The task to run.
+ * \param count How many threads to use. If threads are not supported, the task is
+ *              run exactly once on the calling thread.
+ */
+void run_threads(runnable & task, size_t count);
+
+/*!
+ * \return the number of threads that can run concurrently on this system
+ *         or \c 1 if that number is not known or threads are not supported.
+ */
+size_t hardware_concurrency();
+
+//! \return true if this build supports running tasks on multiple threads.
+inline bool have_threads() { return INNOEXTRACT_HAVE_STD_THREAD; }
+
+} // namespace util
+
+#endif // INNOEXTRACT_UTIL_THREAD_HPP